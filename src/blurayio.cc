@@ -38,6 +38,84 @@
 
 #include <libbluray/bluray.h>
 #include <assert.h>
+#include <algorithm>
+#include <list>
+#include <mutex>
+
+#define BLURAYIO_IDLE_HANDLES   4       /**< @brief Max. number of unused disc handles kept open */
+#define BLURAYIO_IDLE_TIME      60      /**< @brief Seconds an unused disc handle is kept open */
+
+/**
+ * @brief Unused disc handle.
+ *
+ * Opening a disc and scanning its playlists for titles takes long. The handle
+ * of a closed chapter is kept for the next chapter of the same disc, which
+ * selects its title on the handle again.
+ */
+typedef struct BLURAYIDLE
+{
+    std::string     m_path;                                     /**< @brief Path to Bluray */
+    BLURAY *        m_bd;                                       /**< @brief Bluray disk handle, titles already scanned */
+    time_t          m_last_used;                                /**< @brief Time the handle was released */
+} BLURAYIDLE;
+
+static std::list<BLURAYIDLE>    bluray_idle;                    /**< @brief Unused disc handles, most recently used first */
+static std::mutex               bluray_idle_mutex;              /**< @brief Access mutex for bluray_idle */
+
+static BLURAY * idle_get(const std::string & path);
+static void     idle_put(const std::string & path, BLURAY *bd);
+
+/**
+ * @brief Get an unused handle of a disc.
+ * @param[in] path - Path to Bluray.
+ * @return Returns the handle, or nullptr if there is none.
+ */
+static BLURAY * idle_get(const std::string & path)
+{
+    std::lock_guard<std::mutex> lock(bluray_idle_mutex);
+
+    for (std::list<BLURAYIDLE>::iterator it = bluray_idle.begin(); it != bluray_idle.end(); it++)
+    {
+        if (it->m_path == path && time(nullptr) - it->m_last_used < BLURAYIO_IDLE_TIME)
+        {
+            BLURAY *bd = it->m_bd;
+            bluray_idle.erase(it);
+            return bd;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Keep a handle for later use, close old ones.
+ * @param[in] path - Path to Bluray.
+ * @param[in] bd - Bluray disk handle.
+ */
+static void idle_put(const std::string & path, BLURAY *bd)
+{
+    std::lock_guard<std::mutex> lock(bluray_idle_mutex);
+
+    bluray_idle.push_front({ path, bd, time(nullptr) });
+
+    // List is sorted by age, close the oldest handles
+    while (bluray_idle.size() > BLURAYIO_IDLE_HANDLES || time(nullptr) - bluray_idle.back().m_last_used >= BLURAYIO_IDLE_TIME)
+    {
+        bd_close(bluray_idle.back().m_bd);
+        bluray_idle.pop_back();
+    }
+}
+
+void BlurayIO::cleanup(bool all)
+{
+    std::lock_guard<std::mutex> lock(bluray_idle_mutex);
+
+    // List is sorted by age, close the oldest handles
+    while (!bluray_idle.empty() && (all || time(nullptr) - bluray_idle.back().m_last_used >= BLURAYIO_IDLE_TIME))
+    {
+        bd_close(bluray_idle.back().m_bd);
+        bluray_idle.pop_back();
+    }
+}
 
 BlurayIO::BlurayIO()
     : m_bd(nullptr)
@@ -46,6 +124,7 @@ BlurayIO::BlurayIO()
     , m_rest_size(0)
     , m_rest_pos(0)
     , m_cur_pos(0)
+    , m_bd_pos(0)
     , m_start_pos(0)
     , m_end_pos(AV_NOPTS_VALUE)
     , m_full_title(false)
@@ -105,18 +184,28 @@ int BlurayIO::open(LPVIRTUALFILE virtualfile)
 
     Logging::debug(bdpath, "Opening input Bluray.");
 
-    m_bd = bd_open(bdpath, keyfile);
-    if (m_bd == nullptr)
+    m_bd = idle_get(path());
+    if (m_bd != nullptr)
     {
-        Logging::error(bdpath, "Failed to open disc.");
-        return 1;
+        Logging::trace(bdpath, "Reusing disc handle, titles already scanned.");
     }
-
-    title_count = bd_get_titles(m_bd, TITLES_RELEVANT, 0);
-    if (title_count == 0)
+    else
     {
-        Logging::error(bdpath, "No titles found.");
-        return 1;
+        m_bd = bd_open(bdpath, keyfile);
+        if (m_bd == nullptr)
+        {
+            Logging::error(bdpath, "Failed to open disc.");
+            return 1;
+        }
+
+        title_count = bd_get_titles(m_bd, TITLES_RELEVANT, 0);
+        if (title_count == 0)
+        {
+            Logging::error(bdpath, "No titles found.");
+            bd_close(m_bd);
+            m_bd = nullptr;
+            return 1;
+        }
     }
 
     if (!bd_select_title(m_bd, m_title_idx))
@@ -167,6 +256,8 @@ int BlurayIO::open(LPVIRTUALFILE virtualfile)
     bd_free_title_info(ti);
 
     m_start_pos = bd_seek_chapter(m_bd, m_chapter_idx);
+    m_cur_pos   = m_start_pos;
+    m_bd_pos    = m_start_pos;
 
     m_rest_size = 0;
     m_rest_pos = 0;
@@ -178,55 +269,52 @@ size_t BlurayIO::read(void * data, size_t size)
 {
     size_t result_len = 0;
 
-    if (m_rest_size)
+    while (result_len < size)
     {
-        result_len = m_rest_size;
-
-        assert(m_rest_size < size);
-
-        memcpy(data, &m_data[m_rest_pos], m_rest_size);
-
-        m_rest_size = m_rest_pos = 0;
-
-        return result_len;
-    }
-
-    m_cur_pos = static_cast<int64_t>(bd_tell(m_bd));
-    if (m_end_pos < 0 || m_cur_pos < m_end_pos)
-    {
-        int maxsize = sizeof(m_data);
-
-        if (maxsize > (m_end_pos - m_cur_pos))
-        {
-            maxsize = static_cast<int>(m_end_pos - m_cur_pos);
-        }
-
-        int res = bd_read(m_bd, m_data, maxsize);
-        if (res < 0)
+        if (!m_rest_size)
         {
-            Logging::error(path(), "bd_read fail");
-            return 0;
+            // Buffer empty, get next chunk
+            if (m_end_pos >= 0 && m_bd_pos >= m_end_pos)
+            {
+                break;
+            }
+
+            int64_t maxsize = sizeof(m_data);
+
+            if (m_end_pos >= 0 && maxsize > (m_end_pos - m_bd_pos))
+            {
+                maxsize = m_end_pos - m_bd_pos;
+            }
+
+            int res = bd_read(m_bd, m_data, static_cast<int>(maxsize));
+            if (res < 0)
+            {
+                Logging::error(path(), "bd_read fail");
+                m_errno = EIO;
+                break;
+            }
+
+            if (!res)
+            {
+                break;
+            }
+
+            m_bd_pos    += res;
+            m_rest_pos  = 0;
+            m_rest_size = static_cast<size_t>(res);
         }
 
-        size_t bytes = static_cast<size_t>(res);
+        size_t len = std::min(size - result_len, m_rest_size);
 
-        m_cur_pos = static_cast<int64_t>(bd_tell(m_bd));
+        memcpy(static_cast<uint8_t *>(data) + result_len, &m_data[m_rest_pos], len);
 
-        if (bytes > size)
-        {
-            result_len = size;
-            memcpy(data, m_data, result_len);
-
-            m_rest_size = bytes - size;
-            m_rest_pos = size;
-        }
-        else
-        {
-            result_len = bytes;
-            memcpy(data, m_data, result_len);
-        }
+        m_rest_pos  += len;
+        m_rest_size -= len;
+        result_len  += len;
     }
 
+    m_cur_pos += static_cast<int64_t>(result_len);
+
     return result_len;
 }
 
@@ -247,7 +335,7 @@ size_t BlurayIO::size() const
 
 size_t BlurayIO::tell() const
 {
-    return static_cast<size_t>(static_cast<int64_t>(bd_tell(m_bd)) - m_start_pos);
+    return static_cast<size_t>(m_cur_pos - m_start_pos);
 }
 
 int BlurayIO::seek(int64_t offset, int whence)
@@ -263,7 +351,7 @@ int BlurayIO::seek(int64_t offset, int whence)
     }
     case SEEK_CUR:
     {
-        seek_pos = m_start_pos + offset + static_cast<int64_t>(bd_tell(m_bd));
+        seek_pos = m_cur_pos + offset;
         break;
     }
     case SEEK_END:
@@ -281,6 +369,7 @@ int BlurayIO::seek(int64_t offset, int whence)
     if (seek_pos > m_end_pos)
     {
         m_cur_pos = m_end_pos;  // Cannot go beyond EOF. Set position to end, leave errno untouched.
+        m_rest_size = m_rest_pos = 0;
         return 0;
     }
 
@@ -290,7 +379,20 @@ int BlurayIO::seek(int64_t offset, int whence)
         return (EOF);
     }
 
-    m_cur_pos = bd_seek(m_bd, static_cast<uint64_t>(seek_pos));
+    int64_t buf_start = m_cur_pos - static_cast<int64_t>(m_rest_pos);
+
+    if (seek_pos >= buf_start && seek_pos < m_bd_pos && m_rest_pos + m_rest_size == static_cast<size_t>(m_bd_pos - buf_start))
+    {
+        // Still in buffer, no need to ask libbluray
+        m_rest_pos  = static_cast<size_t>(seek_pos - buf_start);
+        m_rest_size = static_cast<size_t>(m_bd_pos - seek_pos);
+        m_cur_pos   = seek_pos;
+        return 0;
+    }
+
+    m_rest_size = m_rest_pos = 0;
+
+    m_cur_pos = m_bd_pos = bd_seek(m_bd, static_cast<uint64_t>(seek_pos));
 
     return (m_cur_pos == seek_pos ? 0 : -1);
 }
@@ -302,7 +404,12 @@ bool BlurayIO::eof() const
 
 void BlurayIO::close()
 {
-    bd_close(m_bd);
+    if (m_bd != nullptr)
+    {
+        // Keep for the next chapter of this disc
+        idle_put(path(), m_bd);
+        m_bd = nullptr;
+    }
 }
 
 #endif // USE_LIBBLURAY
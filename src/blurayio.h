@@ -42,6 +42,9 @@
 
 typedef struct bluray BLURAY;               /**< @brief Forward declaration of libbluray handle */
 
+#define BLURAYIO_ALIGNED_UNIT   6144                            /**< @brief Size of a Bluray aligned unit (32 source packets) */
+#define BLURAYIO_BUFFER_SIZE    (BLURAYIO_ALIGNED_UNIT * 64)    /**< @brief Read buffer size, a multiple of aligned units so bd_read() never splits one */
+
 /** @brief Bluray I/O class
  *
  * @bug Issue #27: Bluray chapters stop prematurely.\n
@@ -128,6 +131,11 @@ public:
      * @brief Close virtual file.
      */
     virtual void    close();
+    /**
+     * @brief Close unused disc handles kept for later use.
+     * @param[in] all - If true, close all unused handles, otherwise only those unused for BLURAYIO_IDLE_TIME seconds.
+     */
+    static void     cleanup(bool all);
 
 protected:
     BLURAY *        m_bd;                                       /**< @brief Bluray disk handle */
@@ -136,7 +144,8 @@ protected:
     int             m_errno;                                    /**< @brief Last errno */
     size_t          m_rest_size;                                /**< @brief Rest bytes in buffer */
     size_t          m_rest_pos;                                 /**< @brief Position in buffer */
-    int64_t         m_cur_pos;                                  /**< @brief Current position in virtual file */
+    int64_t         m_cur_pos;                                  /**< @brief Current read position on disk, including the bytes taken from m_data */
+    int64_t         m_bd_pos;                                   /**< @brief Position of libbluray, i.e. end of data in m_data */
     int64_t         m_start_pos;                                /**< @brief Start offset in bytes */
     int64_t         m_end_pos;                                  /**< @brief End offset in bytes (not including this byte) */
 
@@ -145,7 +154,7 @@ protected:
     unsigned        m_chapter_idx;                              /**< @brief Chapter index (chapter number - 1) */
     unsigned        m_angle_idx;                                /**< @brief Selected angle index (angle number -1) */
 
-    uint8_t         m_data[192 * 1024];                         /**< @brief Buffer for read() data */
+    uint8_t         m_data[BLURAYIO_BUFFER_SIZE];               /**< @brief Buffer for read() data */
 
     int64_t         m_duration;                                 /**< @brief Track/chapter duration, in AV_TIME_BASE fractional seconds. */
 };
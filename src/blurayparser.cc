@@ -594,9 +594,19 @@ int check_bluray(const std::string & _path, void *buf, fuse_fill_dir_t filler)
     {
         if (!check_path(path))
         {
-            Logging::trace(path, "Bluray detected.");
-            res = parse_bluray(path, &stbuf, buf, filler);
-            Logging::trace(path, "Found %1 titles.", res);
+            uint64_t stamp = disc_stamp(path);
+
+            res = load_disc(VIRTUALTYPE_BLURAY, path, stamp, &stbuf, buf, filler);
+            if (!res)
+            {
+                Logging::trace(path, "Bluray detected.");
+                res = parse_bluray(path, &stbuf, buf, filler);
+                Logging::trace(path, "Found %1 titles.", res);
+                if (res > 0)
+                {
+                    save_disc(VIRTUALTYPE_BLURAY, path, stamp);
+                }
+            }
         }
         else
         {
@@ -43,6 +43,7 @@
 Buffer::Buffer()
     : m_cur_ci(nullptr)
     , m_cur_open(0)
+    , m_read_segment(0)
 {
 }
 
@@ -298,6 +299,13 @@ bool Buffer::set_segment(uint32_t segment_no)
 
     m_cur_ci = &m_ci[segment_no - 1];
 
+    if (!m_cur_ci->m_seg_finished)
+    {
+        // Segment will be written from scratch, drop leftovers of an earlier, incomplete run.
+        m_cur_ci->m_buffer_pos          = 0;
+        m_cur_ci->m_buffer_watermark    = 0;
+    }
+
     return true;
 }
 
@@ -567,7 +575,12 @@ bool Buffer::clear()
     m_cur_ci->m_buffer_pos          = 0;
     m_cur_ci->m_buffer_watermark    = 0;
     m_cur_ci->m_buffer_size         = 0;
-    m_cur_ci->m_seg_finished        = false;
+
+    // Starting over, so no segment can be complete.
+    for (uint32_t index = 0; index < segment_count(); index++)
+    {
+        m_ci[index].m_seg_finished  = false;
+    }
 
     // If empty set file size to 1 page
     long filesize = sysconf (_SC_PAGESIZE);
@@ -867,6 +880,11 @@ bool Buffer::copy(uint8_t* out_data, size_t offset, size_t bufsize, uint32_t seg
         }
 
         memcpy(out_data, ci->m_buffer + offset, bufsize);
+
+        if (segment_no)
+        {
+            m_read_segment = segment_no;
+        }
     }
     else
     {
@@ -1054,6 +1072,81 @@ bool Buffer::is_segment_finished(uint32_t segment_no) const
     return ci->m_seg_finished;
 }
 
+uint32_t Buffer::next_unfinished_segment(uint32_t segment_no) const
+{
+    if (!segment_no)
+    {
+        segment_no = 1;
+    }
+
+    for (; segment_no <= m_ci.size(); segment_no++)
+    {
+        if (!m_ci[segment_no - 1].m_seg_finished)
+        {
+            return segment_no;
+        }
+    }
+
+    return 0;
+}
+
+void Buffer::get_finished_segments(std::vector<uint8_t> * bitmap) const
+{
+    std::lock_guard<std::recursive_mutex> lck (m_mutex);
+
+    bitmap->clear();
+
+    for (size_t index = 0; index < m_ci.size(); index++)
+    {
+        if (m_ci[index].m_seg_finished)
+        {
+            if (bitmap->size() <= index / 8)
+            {
+                bitmap->resize(index / 8 + 1, 0);
+            }
+            (*bitmap)[index / 8] |= static_cast<uint8_t>(1 << (index % 8));
+        }
+    }
+}
+
+void Buffer::set_finished_segments(const std::vector<uint8_t> & bitmap)
+{
+    std::lock_guard<std::recursive_mutex> lck (m_mutex);
+
+    for (size_t index = 0; index < m_ci.size(); index++)
+    {
+        bool finished = (index / 8 < bitmap.size()) && (bitmap[index / 8] & (1 << (index % 8)));
+
+        // Do not trust the index if the cache file has gone away
+        m_ci[index].m_seg_finished = finished && file_exists(m_ci[index].m_cachefile);
+    }
+}
+
+uint32_t Buffer::read_segment() const
+{
+    return m_read_segment;
+}
+
+size_t Buffer::mapped_size()
+{
+    std::lock_guard<std::recursive_mutex> lck (m_mutex);
+    size_t total = 0;
+
+    for (size_t index = 0; index < m_ci.size(); index++)
+    {
+        if (m_ci[index].m_buffer != nullptr)
+        {
+            total += m_ci[index].m_buffer_size;
+        }
+        if (m_ci[index].m_buffer_idx != nullptr)
+        {
+            total += m_ci[index].m_buffer_size_idx;
+        }
+    }
+
+    return total;
+}
+
 Buffer::LPCACHEINFO Buffer::cacheinfo(uint32_t segment_no)
 {
     if (segment_no)
@@ -38,6 +38,7 @@
 
 #include <mutex>
 #include <vector>
+#include <atomic>
 #include <stddef.h>
 
 #define CACHE_CHECK_BIT(mask, var)  ((mask) == (mask & (var)))  /**< @brief Check bit in bitmask */
@@ -344,6 +345,38 @@ public:
      * @return Returns true if finished, false if not.
      */
     bool                    is_segment_finished(uint32_t segment_no) const;
+    /**
+     * @brief Get the next segment that has not yet been completely transcoded.
+     * @param[in] segment_no - HLS segment file number [1..n] to start searching at.
+     * @return Returns the first unfinished segment number >= segment_no, or 0 if all remaining segments are finished.
+     */
+    uint32_t                next_unfinished_segment(uint32_t segment_no) const;
+    /**
+     * @brief Get the HLS segment most recently read by a client.
+     * @return Returns the segment number [1..n], or 0 if no segment has been read yet.
+     */
+    uint32_t                read_segment() const;
+    /**
+     * @brief Get a bitmap of all completely transcoded segments.
+     *
+     * Bit n (counting from the least significant bit of the first byte) is set if segment n + 1 is finished.
+     *
+     * @param[out] bitmap - Bitmap of finished segments. Will be empty if no segment has been finished.
+     */
+    void                    get_finished_segments(std::vector<uint8_t> * bitmap) const;
+    /**
+     * @brief Restore the finished state of segments, e.g. from the cache index.
+     *
+     * Segments are only marked finished if their cache file still exists.
+     *
+     * @param[in] bitmap - Bitmap of finished segments as returned by get_finished_segments().
+     */
+    void                    set_finished_segments(const std::vector<uint8_t> & bitmap);
+    /**
+     * @brief Get the amount of memory currently mapped for cache files of this buffer.
+     * @return Returns the mapped size in bytes, including index files.
+     */
+    size_t                  mapped_size();
     /**
      * @brief Open cache file if not already open.
      * @param[in] index - Index of segment file number [0..n-1].
@@ -440,9 +473,10 @@ private:
     LPCCACHEINFO            const_cacheinfo(uint32_t segment_no) const;
 
 private:
-    std::recursive_mutex    m_mutex;                            /**< @brief Access mutex */
+    mutable std::recursive_mutex m_mutex;                       /**< @brief Access mutex, mutable to lock in const functions */
     LPCACHEINFO             m_cur_ci;                           /**< @brief Convenience pointer to current write segment */
     uint32_t                m_cur_open;                         /**< @brief Number of open files */
+    std::atomic_uint32_t    m_read_segment;                     /**< @brief HLS segment most recently read by a client */
 
     std::vector<CACHEINFO>  m_ci;                               /**< @brief Cache info */
 };
@@ -87,6 +87,7 @@ const Cache::TABLE_COLUMNS Cache::m_columns_cache_entry[] =
     { "access_time",        "DATETIME NOT NULL" },
     { "file_time",          "DATETIME NOT NULL" },
     { "file_size",          "UNSIGNED BIG INT NOT NULL" },
+    { "finished_segments",  "BLOB NOT NULL DEFAULT x''" },
     // Stop
     { nullptr,              nullptr }
 };
@@ -109,6 +110,51 @@ const Cache::TABLE_COLUMNS Cache::m_columns_version[] =
     { nullptr,              nullptr }
 };
 
+const Cache::TABLE_DEF Cache::m_table_disc_title =
+{
+    //
+    // Table name
+    //
+    "disc_title",
+    //
+    // Primary key
+    //
+    "PRIMARY KEY(`disc_path`,`desttype`,`filename`)"
+};
+
+const Cache::TABLE_COLUMNS Cache::m_columns_disc_title[] =
+{
+    //
+    // Primary key: disc path + desttype + virtual file name
+    //
+    { "disc_path",          "TEXT NOT NULL" },
+    { "desttype",           "CHAR ( 10 ) NOT NULL" },
+    { "filename",           "TEXT NOT NULL" },
+    //
+    // Disc structure, titles are outdated if changed
+    //
+    { "stamp",              "UNSIGNED BIG INT NOT NULL" },
+    //
+    // Virtual file
+    //
+    { "flags",              "INT NOT NULL" },
+    { "mode",               "UNSIGNED INT NOT NULL" },
+    { "nlink",              "UNSIGNED INT NOT NULL" },
+    { "size",               "UNSIGNED BIG INT NOT NULL" },
+    { "full_title",         "BOOLEAN NOT NULL" },
+    { "title_no",           "UNSIGNED INT NOT NULL" },
+    { "chapter_no",         "UNSIGNED INT NOT NULL" },
+    { "angle_no",           "UNSIGNED INT NOT NULL" },
+    { "playlist_no",        "UNSIGNED INT NOT NULL" },
+    { "start_pos",          "UNSIGNED BIG INT NOT NULL" },
+    { "end_pos",            "UNSIGNED BIG INT NOT NULL" },
+    { "duration",           "UNSIGNED BIG INT NOT NULL" },
+    { "predicted_size",     "UNSIGNED BIG INT NOT NULL" },
+    { "video_frame_count",  "UNSIGNED BIG INT NOT NULL" },
+    // Stop
+    { nullptr,              nullptr }
+};
+
 Cache::Cache()
     : m_cacheidx_db(nullptr)
     , m_cacheidx_select_stmt(nullptr)
@@ -136,8 +182,8 @@ bool Cache::prepare_stmts()
     const char * sql;
 
     sql =   "INSERT OR REPLACE INTO cache_entry\n"
-            "(filename, desttype, enable_ismv, audiobitrate, audiosamplerate, videobitrate, videowidth, videoheight, deinterlace, duration, predicted_filesize, encoded_filesize, video_frame_count, segment_count, finished, error, errno, averror, creation_time, access_time, file_time, file_size) VALUES\n"
-            "(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, datetime(?, 'unixepoch'), datetime(?, 'unixepoch'), datetime(?, 'unixepoch'), ?);\n";
+            "(filename, desttype, enable_ismv, audiobitrate, audiosamplerate, videobitrate, videowidth, videoheight, deinterlace, duration, predicted_filesize, encoded_filesize, video_frame_count, segment_count, finished, error, errno, averror, creation_time, access_time, file_time, file_size, finished_segments) VALUES\n"
+            "(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, datetime(?, 'unixepoch'), datetime(?, 'unixepoch'), datetime(?, 'unixepoch'), ?, ?);\n";
 
     if (SQLITE_OK != (ret = sqlite3_prepare_v2(m_cacheidx_db, sql, -1, &m_cacheidx_insert_stmt, nullptr)))
     {
@@ -145,7 +191,7 @@ bool Cache::prepare_stmts()
         return false;
     }
 
-    sql =   "SELECT desttype, enable_ismv, audiobitrate, audiosamplerate, videobitrate, videowidth, videoheight, deinterlace, duration, predicted_filesize, encoded_filesize, video_frame_count, segment_count, finished, error, errno, averror, strftime('%s', creation_time), strftime('%s', access_time), strftime('%s', file_time), file_size FROM cache_entry WHERE filename = ? AND desttype = ?;\n";
+    sql =   "SELECT desttype, enable_ismv, audiobitrate, audiosamplerate, videobitrate, videowidth, videoheight, deinterlace, duration, predicted_filesize, encoded_filesize, video_frame_count, segment_count, finished, error, errno, averror, strftime('%s', creation_time), strftime('%s', access_time), strftime('%s', file_time), file_size, finished_segments FROM cache_entry WHERE filename = ? AND desttype = ?;\n";
 
     if (SQLITE_OK != (ret = sqlite3_prepare_v2(m_cacheidx_db, sql, -1, &m_cacheidx_select_stmt, nullptr)))
     {
@@ -517,6 +563,24 @@ bool Cache::upgrade_db(int *db_version_major, int *db_version_minor)
         }
     }
 
+    if (!column_exists("cache_entry", "finished_segments"))
+    {
+        std::string sql;
+
+        Logging::debug(m_cacheidx_file, "Adding `finished_segments` column.");
+
+        // Add `finished_segments` BLOB NOT NULL DEFAULT x''
+        sql = "ALTER TABLE `";
+        sql += m_table_cache_entry.name;
+        sql += "` ADD COLUMN `finished_segments` BLOB NOT NULL DEFAULT x'';\n";
+        if (SQLITE_OK != (ret = sqlite3_exec(m_cacheidx_db, sql.c_str(), nullptr, nullptr, &errmsg)))
+        {
+            Logging::error(m_cacheidx_file, "SQLite3 exec error adding column `finished_segments`: (%1) %2\n%3", ret, errmsg, sql.c_str());
+            sqlite3_free(errmsg);
+            return false;
+        }
+    }
+
     // Update DB version
     Logging::debug(m_cacheidx_file, "Updating version table to V%1.%2.", DB_VERSION_MAJOR, DB_VERSION_MINOR);
 
@@ -607,6 +671,18 @@ bool Cache::load_index()
             new_database = true;    //  Created a new database
         }
 
+        // Create disc_title table if not already existing. Older versions simply do not use it.
+        if (!table_exists("disc_title"))
+        {
+            Logging::debug(m_cacheidx_file, "Creating 'disc_title' table in database.");
+
+            if (!create_table_cache_entry(&m_table_disc_title, m_columns_disc_title))
+            {
+                Logging::error(m_cacheidx_file, "SQLite3 exec error creating 'disc_title' table: (%1) %2", ret, errmsg);
+                throw false;
+            }
+        }
+
         // If version table does not exist add it
         if (!table_exists("version"))
         {
@@ -718,6 +794,7 @@ bool Cache::read_info(LPCACHE_INFO cache_info)
     cache_info->m_access_time        = 0;
     cache_info->m_file_time          = 0;
     cache_info->m_file_size          = 0;
+    cache_info->m_finished_segments.clear();
 
     if (m_cacheidx_select_stmt == nullptr)
     {
@@ -773,6 +850,11 @@ bool Cache::read_info(LPCACHE_INFO cache_info)
             cache_info->m_access_time           = static_cast<time_t>(sqlite3_column_int64(m_cacheidx_select_stmt, 18));
             cache_info->m_file_time             = static_cast<time_t>(sqlite3_column_int64(m_cacheidx_select_stmt, 19));
             cache_info->m_file_size             = static_cast<size_t>(sqlite3_column_int64(m_cacheidx_select_stmt, 20));
+            const uint8_t *blob                 = static_cast<const uint8_t *>(sqlite3_column_blob(m_cacheidx_select_stmt, 21));
+            if (blob != nullptr)
+            {
+                cache_info->m_finished_segments.assign(blob, blob + sqlite3_column_bytes(m_cacheidx_select_stmt, 21));
+            }
         }
         else if (ret != SQLITE_DONE)
         {
@@ -802,6 +884,13 @@ bool Cache::read_info(LPCACHE_INFO cache_info)
     throw false; \
     }       /**< @brief Bind text column to SQLite statement */
 
+#define SQLBINDBLOB(idx, var, size) \
+    if (SQLITE_OK != (ret = sqlite3_bind_blob(m_cacheidx_insert_stmt, idx, var, size, nullptr))) \
+{ \
+    Logging::error(m_cacheidx_file, "SQLite3 select column #%1 error: %2\n%3", idx, ret, sqlite3_errstr(ret)); \
+    throw false; \
+    }       /**< @brief Bind blob column to SQLite statement */
+
 #define SQLBINDNUM(func, idx, var) \
     if (SQLITE_OK != (ret = func(m_cacheidx_insert_stmt, idx, var))) \
 { \
@@ -826,7 +915,7 @@ bool Cache::write_info(LPCCACHE_INFO cache_info)
     {
         bool enable_ismv_dummy = 0;
 
-        assert(sqlite3_bind_parameter_count(m_cacheidx_insert_stmt) == 22);
+        assert(sqlite3_bind_parameter_count(m_cacheidx_insert_stmt) == 23);
 
         SQLBINDTXT(1, cache_info->m_origfile.c_str());
         SQLBINDTXT(2, cache_info->m_desttype);
@@ -851,6 +940,8 @@ bool Cache::write_info(LPCCACHE_INFO cache_info)
         SQLBINDNUM(sqlite3_bind_int64,  20, cache_info->m_access_time);
         SQLBINDNUM(sqlite3_bind_int64,  21, cache_info->m_file_time);
         SQLBINDNUM(sqlite3_bind_int64,  22, static_cast<sqlite3_int64>(cache_info->m_file_size));
+        // Bind an empty blob rather than NULL if no segments are finished
+        SQLBINDBLOB(23, cache_info->m_finished_segments.empty() ? "" : static_cast<const void *>(cache_info->m_finished_segments.data()), static_cast<int>(cache_info->m_finished_segments.size()));
 
         ret = sqlite3_step(m_cacheidx_insert_stmt);
 
@@ -927,6 +1018,244 @@ bool Cache::delete_info(const std::string & filename, const std::string & destty
     return success;
 }
 
+bool Cache::read_disc(const std::string & discpath, const std::string & desttype, uint64_t stamp, std::vector<VIRTUALFILE> *virtualfiles)
+{
+    sqlite3_stmt * stmt = nullptr;
+    const char * sql;
+    int ret;
+    bool success = true;
+
+    virtualfiles->clear();
+
+    if (m_cacheidx_db == nullptr)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::recursive_mutex> lck (m_mutex);
+
+    try
+    {
+        sql = "SELECT filename, flags, mode, nlink, size, full_title, title_no, chapter_no, angle_no, playlist_no, start_pos, end_pos, duration, predicted_size, video_frame_count FROM disc_title WHERE disc_path = ? AND desttype = ? AND stamp = ?;\n";
+
+        if (SQLITE_OK != (ret = sqlite3_prepare_v2(m_cacheidx_db, sql, -1, &stmt, nullptr)))
+        {
+            Logging::error(m_cacheidx_file, "Failed to prepare select: (%1) %2\n%3", ret, sqlite3_errmsg(m_cacheidx_db), sql);
+            throw false;
+        }
+
+        if (SQLITE_OK != (ret = sqlite3_bind_text(stmt, 1, discpath.c_str(), -1, nullptr)) ||
+                SQLITE_OK != (ret = sqlite3_bind_text(stmt, 2, desttype.c_str(), -1, nullptr)) ||
+                SQLITE_OK != (ret = sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(stamp))))
+        {
+            Logging::error(m_cacheidx_file, "SQLite3 select error binding disc title key: (%1) %2", ret, sqlite3_errstr(ret));
+            throw false;
+        }
+
+        while ((ret = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            VIRTUALFILE virtualfile;
+
+            virtualfile.m_origfile              = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+            virtualfile.m_flags                 = sqlite3_column_int(stmt, 1);
+            memset(&virtualfile.m_st, 0, sizeof(virtualfile.m_st));
+            virtualfile.m_st.st_mode            = static_cast<mode_t>(sqlite3_column_int(stmt, 2));
+            virtualfile.m_st.st_nlink           = static_cast<nlink_t>(sqlite3_column_int(stmt, 3));
+            virtualfile.m_st.st_size            = static_cast<off_t>(sqlite3_column_int64(stmt, 4));
+            virtualfile.m_full_title            = sqlite3_column_int(stmt, 5) ? true : false;
+#ifdef USE_LIBVCD
+            virtualfile.m_vcd.m_track_no        = sqlite3_column_int(stmt, 6);
+            virtualfile.m_vcd.m_chapter_no      = sqlite3_column_int(stmt, 7);
+            virtualfile.m_vcd.m_start_pos       = static_cast<uint64_t>(sqlite3_column_int64(stmt, 10));
+            virtualfile.m_vcd.m_end_pos         = static_cast<uint64_t>(sqlite3_column_int64(stmt, 11));
+#endif // USE_LIBVCD
+#ifdef USE_LIBDVD
+            virtualfile.m_dvd.m_title_no        = sqlite3_column_int(stmt, 6);
+            virtualfile.m_dvd.m_chapter_no      = sqlite3_column_int(stmt, 7);
+            virtualfile.m_dvd.m_angle_no        = sqlite3_column_int(stmt, 8);
+#endif // USE_LIBDVD
+#ifdef USE_LIBBLURAY
+            virtualfile.m_bluray.m_title_no     = static_cast<uint32_t>(sqlite3_column_int(stmt, 6));
+            virtualfile.m_bluray.m_chapter_no   = static_cast<unsigned>(sqlite3_column_int(stmt, 7));
+            virtualfile.m_bluray.m_angle_no     = static_cast<unsigned>(sqlite3_column_int(stmt, 8));
+            virtualfile.m_bluray.m_playlist_no  = static_cast<uint32_t>(sqlite3_column_int(stmt, 9));
+#endif // USE_LIBBLURAY
+            virtualfile.m_duration              = sqlite3_column_int64(stmt, 12);
+            virtualfile.m_predicted_size        = static_cast<size_t>(sqlite3_column_int64(stmt, 13));
+            virtualfile.m_video_frame_count     = static_cast<uint32_t>(sqlite3_column_int64(stmt, 14));
+
+            virtualfiles->push_back(virtualfile);
+        }
+
+        if (ret != SQLITE_DONE)
+        {
+            Logging::error(m_cacheidx_file, "Sqlite 3 could not step (execute) select statement: (%1) %2", ret, sqlite3_errstr(ret));
+            throw false;
+        }
+
+        success = !virtualfiles->empty();
+    }
+    catch (bool _success)
+    {
+        success = _success;
+        virtualfiles->clear();
+    }
+
+    sqlite3_finalize(stmt);
+
+    errno = 0; // sqlite3 sometimes sets errno without any reason, better reset any error
+
+    return success;
+}
+
+bool Cache::write_disc(const std::string & discpath, const std::string & desttype, uint64_t stamp, const std::vector<LPCVIRTUALFILE> & virtualfiles)
+{
+    sqlite3_stmt * stmt = nullptr;
+    const char * sql;
+    int ret;
+    bool success = true;
+
+    if (m_cacheidx_db == nullptr)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::recursive_mutex> lck (m_mutex);
+
+    if (!begin_transaction())
+    {
+        return false;
+    }
+
+    try
+    {
+        // Remove titles of earlier scans
+        sql = "DELETE FROM disc_title WHERE disc_path = ? AND desttype = ?;\n";
+
+        if (SQLITE_OK != (ret = sqlite3_prepare_v2(m_cacheidx_db, sql, -1, &stmt, nullptr)))
+        {
+            Logging::error(m_cacheidx_file, "Failed to prepare delete: (%1) %2\n%3", ret, sqlite3_errmsg(m_cacheidx_db), sql);
+            throw false;
+        }
+
+        if (SQLITE_OK != (ret = sqlite3_bind_text(stmt, 1, discpath.c_str(), -1, nullptr)) ||
+                SQLITE_OK != (ret = sqlite3_bind_text(stmt, 2, desttype.c_str(), -1, nullptr)) ||
+                SQLITE_DONE != (ret = sqlite3_step(stmt)))
+        {
+            Logging::error(m_cacheidx_file, "Sqlite 3 could not execute delete statement: (%1) %2", ret, sqlite3_errstr(ret));
+            throw false;
+        }
+
+        sqlite3_finalize(stmt);
+        stmt = nullptr;
+
+        sql = "INSERT INTO disc_title (disc_path, desttype, filename, stamp, flags, mode, nlink, size, full_title, title_no, chapter_no, angle_no, playlist_no, start_pos, end_pos, duration, predicted_size, video_frame_count) VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);\n";
+
+        if (SQLITE_OK != (ret = sqlite3_prepare_v2(m_cacheidx_db, sql, -1, &stmt, nullptr)))
+        {
+            Logging::error(m_cacheidx_file, "Failed to prepare insert: (%1) %2\n%3", ret, sqlite3_errmsg(m_cacheidx_db), sql);
+            throw false;
+        }
+
+        for (LPCVIRTUALFILE virtualfile : virtualfiles)
+        {
+            int title_no        = 0;
+            int chapter_no      = 0;
+            int angle_no        = 0;
+            int playlist_no     = 0;
+            uint64_t start_pos  = 0;
+            uint64_t end_pos    = 0;
+
+            switch (virtualfile->m_type)
+            {
+#ifdef USE_LIBVCD
+            case VIRTUALTYPE_VCD:
+            {
+                title_no    = virtualfile->m_vcd.m_track_no;
+                chapter_no  = virtualfile->m_vcd.m_chapter_no;
+                start_pos   = virtualfile->m_vcd.m_start_pos;
+                end_pos     = virtualfile->m_vcd.m_end_pos;
+                break;
+            }
+#endif // USE_LIBVCD
+#ifdef USE_LIBDVD
+            case VIRTUALTYPE_DVD:
+            {
+                title_no    = virtualfile->m_dvd.m_title_no;
+                chapter_no  = virtualfile->m_dvd.m_chapter_no;
+                angle_no    = virtualfile->m_dvd.m_angle_no;
+                break;
+            }
+#endif // USE_LIBDVD
+#ifdef USE_LIBBLURAY
+            case VIRTUALTYPE_BLURAY:
+            {
+                title_no    = static_cast<int>(virtualfile->m_bluray.m_title_no);
+                chapter_no  = static_cast<int>(virtualfile->m_bluray.m_chapter_no);
+                angle_no    = static_cast<int>(virtualfile->m_bluray.m_angle_no);
+                playlist_no = static_cast<int>(virtualfile->m_bluray.m_playlist_no);
+                break;
+            }
+#endif // USE_LIBBLURAY
+            default:
+            {
+                break;
+            }
+            }
+
+            if (SQLITE_OK != (ret = sqlite3_bind_text(stmt, 1, discpath.c_str(), -1, nullptr)) ||
+                    SQLITE_OK != (ret = sqlite3_bind_text(stmt, 2, desttype.c_str(), -1, nullptr)) ||
+                    SQLITE_OK != (ret = sqlite3_bind_text(stmt, 3, virtualfile->m_origfile.c_str(), -1, nullptr)) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int64(stmt, 4, static_cast<sqlite3_int64>(stamp))) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int(stmt, 5, virtualfile->m_flags)) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int(stmt, 6, static_cast<int>(virtualfile->m_st.st_mode))) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int(stmt, 7, static_cast<int>(virtualfile->m_st.st_nlink))) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int64(stmt, 8, static_cast<sqlite3_int64>(virtualfile->m_st.st_size))) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int(stmt, 9, virtualfile->m_full_title)) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int(stmt, 10, title_no)) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int(stmt, 11, chapter_no)) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int(stmt, 12, angle_no)) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int(stmt, 13, playlist_no)) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int64(stmt, 14, static_cast<sqlite3_int64>(start_pos))) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int64(stmt, 15, static_cast<sqlite3_int64>(end_pos))) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int64(stmt, 16, static_cast<sqlite3_int64>(virtualfile->m_duration))) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int64(stmt, 17, static_cast<sqlite3_int64>(virtualfile->m_predicted_size))) ||
+                    SQLITE_OK != (ret = sqlite3_bind_int64(stmt, 18, static_cast<sqlite3_int64>(virtualfile->m_video_frame_count))))
+            {
+                Logging::error(m_cacheidx_file, "SQLite3 insert error binding disc title: (%1) %2", ret, sqlite3_errstr(ret));
+                throw false;
+            }
+
+            if (SQLITE_DONE != (ret = sqlite3_step(stmt)))
+            {
+                Logging::error(m_cacheidx_file, "Sqlite 3 could not step (execute) insert statement: (%1) %2", ret, sqlite3_errstr(ret));
+                throw false;
+            }
+
+            sqlite3_reset(stmt);
+        }
+    }
+    catch (bool _success)
+    {
+        success = _success;
+    }
+
+    sqlite3_finalize(stmt);
+
+    if (success)
+    {
+        success = end_transaction();
+    }
+    else
+    {
+        rollback_transaction();
+    }
+
+    errno = 0; // sqlite3 sometimes sets errno without any reason, better reset any error
+
+    return success;
+}
+
 void Cache::close_index()
 {
     if (m_cacheidx_db != nullptr)
@@ -1325,6 +1654,13 @@ bool Cache::clear()
 
     sqlite3_finalize(stmt);
 
+    sql = "DELETE FROM disc_title;\n";
+    if (SQLITE_OK != (ret = sqlite3_exec(m_cacheidx_db, sql, nullptr, nullptr, nullptr)))
+    {
+        Logging::error(m_cacheidx_file, "Failed to clear disc titles: (%1) %2", ret, sqlite3_errmsg(m_cacheidx_db));
+        success = false;
+    }
+
     return success;
 }
 
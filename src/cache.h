@@ -43,10 +43,10 @@
 #define     DB_BASE_VERSION_MINOR   0           /**< @brief The oldest database version minor (Release < 1.95) */
 
 #define     DB_VERSION_MAJOR        1           /**< @brief Current database version major */
-#define     DB_VERSION_MINOR        97          /**< @brief Current database version minor */
+#define     DB_VERSION_MINOR        98          /**< @brief Current database version minor */
 
-#define     DB_MIN_VERSION_MAJOR    1           /**< @brief Required database version major (required 1.95) */
-#define     DB_MIN_VERSION_MINOR    97          /**< @brief Required database version minor (required 1.95) */
+#define     DB_MIN_VERSION_MAJOR    1           /**< @brief Required database version major (required 1.98) */
+#define     DB_MIN_VERSION_MINOR    98          /**< @brief Required database version minor (required 1.98) */
 
 /**
   * @brief RESULTCODE of transcoding operation
@@ -80,6 +80,7 @@ typedef struct CACHE_INFO
     size_t          m_encoded_filesize;         /**< @brief Actual file size after encode */
     uint32_t        m_video_frame_count;        /**< @brief Number of frames in video or 0 if not a video */
     uint32_t        m_segment_count;            /**< @brief Number of video segments for HLS */
+    std::vector<uint8_t> m_finished_segments;   /**< @brief HLS only: Bitmap of completely transcoded segments, see Buffer::get_finished_segments() */
     RESULTCODE      m_finished;                 /**< @brief Result code: */
     bool            m_error;                    /**< @brief true if encode failed */
     int             m_errno;                    /**< @brief errno if encode failed */
@@ -204,6 +205,24 @@ public:
      * @return Returns true on success; false on error.
      */
     bool                    remove_cachefile(const std::string & filename, const std::string &fileext);
+    /**
+     * @brief Get the titles of a DVD, Blu-ray or Video CD that have been found by an earlier scan.
+     * @param[in] discpath - Path to disc.
+     * @param[in] desttype - Destination type. Title names depend on it.
+     * @param[in] stamp - Stamp of the disc structure, see disc_stamp(). If changed, the stored titles are outdated.
+     * @param[out] virtualfiles - Virtual files of the titles, only disc specific fields are set.
+     * @return Returns true if the disc was found with the same stamp; false if not or on error.
+     */
+    bool                    read_disc(const std::string & discpath, const std::string & desttype, uint64_t stamp, std::vector<VIRTUALFILE> *virtualfiles);
+    /**
+     * @brief Store the titles of a DVD, Blu-ray or Video CD, replacing those of an earlier scan.
+     * @param[in] discpath - Path to disc.
+     * @param[in] desttype - Destination type.
+     * @param[in] stamp - Stamp of the disc structure.
+     * @param[in] virtualfiles - Virtual files of the titles.
+     * @return Returns true on success; false on error.
+     */
+    bool                    write_disc(const std::string & discpath, const std::string & desttype, uint64_t stamp, const std::vector<LPCVIRTUALFILE> & virtualfiles);
 
 protected:
     /**
@@ -323,6 +342,10 @@ private:
     TABLE_DEF               m_table_version;
     static const
     TABLE_COLUMNS           m_columns_version[];
+    static const
+    TABLE_DEF               m_table_disc_title;
+    static const
+    TABLE_COLUMNS           m_columns_disc_title[];
 
     std::recursive_mutex    m_mutex;                        /**< @brief Access mutex */
     std::string             m_cacheidx_file;                /**< @brief Name of SQLite cache index database */
@@ -33,14 +33,23 @@
 #include "ffmpegfs.h"
 #include "buffer.h"
 #include "logging.h"
+#include "watcher.h"
 
 #include <string.h>
+#include <unistd.h>
+#include <algorithm>
 
 Cache_Entry::Cache_Entry(Cache *owner, LPVIRTUALFILE virtualfile)
     : m_owner(owner)
     , m_ref_count(0)
     , m_virtualfile(virtualfile)
+    , m_file_checked(0)
     , m_seek_to_no(0)
+    , m_shared_session(-1)
+    , m_shared_owner(false)
+    , m_shared_size(0)
+    , m_shared_fd(-1)
+    , m_shared_reader_access(0)
 {
     m_cache_info.m_origfile = virtualfile->m_origfile;
 
@@ -65,6 +74,8 @@ Cache_Entry::~Cache_Entry()
 {
     std::unique_lock<std::recursive_mutex> lock(m_active_mutex);
 
+    close_shared();
+
     delete m_buffer;
 
     unlock();
@@ -109,6 +120,7 @@ void Cache_Entry::clear(bool fetch_file_time /*= true*/)
     m_cache_info.m_averror              = 0;
     m_cache_info.m_access_time          = m_cache_info.m_creation_time = time(nullptr);
     m_cache_info.m_access_count         = 0;
+    m_cache_info.m_finished_segments.clear();
 
     if (fetch_file_time)
     {
@@ -139,6 +151,12 @@ bool Cache_Entry::read_info()
 
 bool Cache_Entry::write_info()
 {
+    if (m_buffer != nullptr && m_buffer->segment_count())
+    {
+        // Remember which HLS segments are complete so a restart can skip them
+        m_buffer->get_finished_segments(&m_cache_info.m_finished_segments);
+    }
+
     return m_owner->write_info(&m_cache_info);
 }
 
@@ -147,6 +165,22 @@ bool Cache_Entry::delete_info()
     return m_owner->delete_info(filename(), m_cache_info.m_desttype);
 }
 
+bool Cache_Entry::checkpoint()
+{
+    RESULTCODE finished = m_cache_info.m_finished;
+
+    if (finished == RESULTCODE_NONE)
+    {
+        m_cache_info.m_finished = RESULTCODE_INCOMPLETE;
+    }
+
+    bool success = write_info();
+
+    m_cache_info.m_finished = finished;
+
+    return success;
+}
+
 bool Cache_Entry::update_access(bool update_database /*= false*/)
 {
     m_cache_info.m_access_time = time(nullptr);
@@ -197,6 +231,11 @@ bool Cache_Entry::open(bool create_cache /*= true*/)
     // Open the cache
     if (m_buffer->init(erase_cache))
     {
+        if (!erase_cache)
+        {
+            // Restore segments completed by an earlier run
+            m_buffer->set_finished_segments(m_cache_info.m_finished_segments);
+        }
         return true;
     }
     else
@@ -206,8 +245,19 @@ bool Cache_Entry::open(bool create_cache /*= true*/)
     }
 }
 
+void Cache_Entry::close_shared()
+{
+    if (m_shared_fd != -1)
+    {
+        ::close(m_shared_fd);
+        m_shared_fd = -1;
+    }
+}
+
 void Cache_Entry::close_buffer(int flags)
 {
+    close_shared();
+
     if (m_buffer->release(flags))
     {
         if (flags)
@@ -303,12 +353,16 @@ bool Cache_Entry::expired() const
 
 bool Cache_Entry::suspend_timeout() const
 {
-    return (((time(nullptr) - m_cache_info.m_access_time) > params.m_max_inactive_suspend) && m_ref_count <= 1);
+    time_t access_time = std::max(m_cache_info.m_access_time, m_shared_reader_access);
+
+    return (((time(nullptr) - access_time) > params.m_max_inactive_suspend) && m_ref_count <= 1);
 }
 
 bool Cache_Entry::decode_timeout() const
 {
-    return (((time(nullptr) - m_cache_info.m_access_time) > params.m_max_inactive_abort) && m_ref_count <= 1);
+    time_t access_time = std::max(m_cache_info.m_access_time, m_shared_reader_access);
+
+    return (((time(nullptr) - access_time) > params.m_max_inactive_abort) && m_ref_count <= 1);
 }
 
 const std::string & Cache_Entry::filename() const
@@ -370,6 +424,19 @@ bool Cache_Entry::outdated() const
         return true;
     }
 
+    if (watcher_unchanged(filename(), m_file_checked))
+    {
+        // Source not touched since it was checked last
+        return false;
+    }
+
+    std::string dir(filename());
+    remove_filename(&dir);
+    watcher_add(dir);
+
+    // Take before checking, changes while checking will be seen next time
+    uint64_t checked = watcher_sequence();
+
     if (stat(filename().c_str(), &sb) != -1)
     {
         // If source file exists, check file date/size
@@ -386,6 +453,14 @@ bool Cache_Entry::outdated() const
         }
     }
 
+    if (lstat(filename().c_str(), &sb) != -1 && S_ISLNK(sb.st_mode))
+    {
+        // Changes of the link target are not seen by watching the directory of the link, check it every time
+        checked = 0;
+    }
+
+    m_file_checked = checked;
+
     return false;
 }
 
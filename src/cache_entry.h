@@ -118,8 +118,15 @@ public:
      * @return If entry is expired, returns true.
      */
     bool                    expired() const;
+    /**
+     * @brief Close the cache file of a shared session run by another process, if open.
+     */
+    void                    close_shared();
     /**
      * @brief Check for decode suspend timeout.
+     *
+     * Reads by other processes attached to a shared session count as access.
+     *
      * @return Returns true if decoding was suspended.
      */
     bool                    suspend_timeout() const;
@@ -144,6 +151,16 @@ public:
      * @return If update was successful, returns true; returns false on error.
      */
     bool                    update_access(bool update_database = false);
+    /**
+     * @brief Save the progress of a running transcode to the database.
+     *
+     * The entry is stored as incomplete together with the finished HLS segments.
+     * If FFmpegfs is restarted or crashes, the next transcode resumes at the first
+     * unfinished segment instead of starting over.
+     *
+     * @return If update was successful, returns true; returns false on error.
+     */
+    bool                    checkpoint();
     /**
      * @brief Lock the access mutex.
      */
@@ -217,6 +234,8 @@ protected:
 
     LPVIRTUALFILE           m_virtualfile;                  /**< @brief Underlying virtual file object */
 
+    mutable uint64_t        m_file_checked;                 /**< @brief Source watcher sequence number when the source file was checked last, 0 if never or if it must be checked every time (symbolic links) */
+
 public:
     Buffer *                m_buffer;                       /**< @brief Buffer object */
     bool                    m_is_decoding;                  /**< @brief true while file is decoding */
@@ -227,6 +246,13 @@ public:
     ID3v1                   m_id3v1;                        /**< @brief ID3v1 structure which is used to send to clients */
 
     volatile uint32_t       m_seek_to_no;                   /**< @brief If not 0, seeks to specified frame */
+
+    int                     m_shared_session;               /**< @brief Slot in shared session table, or -1 if not shared */
+    bool                    m_shared_owner;                 /**< @brief If true, this process transcodes the shared session, otherwise another process does */
+    std::string             m_shared_cachefile;             /**< @brief Cache file of a completed shared session run by another process */
+    size_t                  m_shared_size;                  /**< @brief Size of m_shared_cachefile */
+    int                     m_shared_fd;                    /**< @brief Open cache file of the process running the shared session, -1 if not open */
+    time_t                  m_shared_reader_access;         /**< @brief Owner only: last time another process has read the shared session */
 };
 
 #endif // CACHE_ENTRY_H
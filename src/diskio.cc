@@ -34,9 +34,25 @@
 #include "logging.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef USE_LIBURING
+#define DISKIO_URING_DEPTH  4                               /**< @brief Number of reads kept in flight */
+#endif // USE_LIBURING
 
 DiskIO::DiskIO()
-    : m_fpi(nullptr)
+    : m_fd(-1)
+    , m_pos(0)
+    , m_size(0)
+    , m_error(0)
+    , m_eof(false)
+#ifdef USE_LIBURING
+    , m_uring(false)
+    , m_uring_slot(0)
+#endif // USE_LIBURING
 {
 
 }
@@ -53,35 +69,108 @@ VIRTUALTYPE DiskIO::type() const
 
 size_t DiskIO::bufsize() const
 {
-    return (100 /* KB */ * 1024);
+    if (!params.m_io_block_size)
+    {
+        return (100 /* KB */ * 1024);
+    }
+    return params.m_io_block_size;
 }
 
 int DiskIO::open(LPVIRTUALFILE virtualfile)
 {
+    struct stat stbuf;
+
     set_virtualfile(virtualfile);
 
     Logging::debug(virtualfile->m_origfile, "Opening input file.");
 
-    m_fpi = fopen(virtualfile->m_origfile.c_str(), "rb");
+    m_pos   = 0;
+    m_size  = 0;
+    m_error = 0;
+    m_eof   = false;
+
+    m_fd = ::open(virtualfile->m_origfile.c_str(), O_RDONLY | O_CLOEXEC);
 
-    if (m_fpi != nullptr)
+    if (m_fd == -1)
     {
-        return 0;
+        return errno;
     }
-    else
+
+    if (fstat(m_fd, &stbuf) == -1)
     {
-        return errno;
+        int orgerrno = errno;
+        close();
+        return orgerrno;
     }
+
+    m_size = static_cast<size_t>(stbuf.st_size);
+
+    // Only a hint, failure does not matter
+    posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    readahead();
+
+#ifdef USE_LIBURING
+    m_uring = uring_init();
+#endif // USE_LIBURING
+
+    return 0;
 }
 
 size_t DiskIO::read(void * data, size_t size)
 {
-    return fread(data, 1, size, m_fpi);
+    if (m_fd == -1)
+    {
+        m_error = errno = EINVAL;
+        return 0;
+    }
+
+#ifdef USE_LIBURING
+    if (m_uring)
+    {
+        return uring_read(data, size);
+    }
+#endif // USE_LIBURING
+
+    return pread_all(data, size);
+}
+
+size_t DiskIO::pread_all(void * data, size_t size)
+{
+    size_t result_len = 0;
+
+    // Short reads may happen anywhere on network or FUSE file systems, only a read of 0 bytes means end of file
+    while (result_len < size)
+    {
+        ssize_t bytes;
+
+        do
+        {
+            bytes = pread(m_fd, static_cast<uint8_t *>(data) + result_len, size - result_len, static_cast<off_t>(m_pos));
+        }
+        while (bytes == -1 && errno == EINTR);
+
+        if (bytes == -1)
+        {
+            m_error = errno;
+            break;
+        }
+
+        if (!bytes)
+        {
+            m_eof = true;
+            break;
+        }
+
+        m_pos       += static_cast<size_t>(bytes);
+        result_len  += static_cast<size_t>(bytes);
+    }
+
+    return result_len;
 }
 
 int DiskIO::error() const
 {
-    return ferror(m_fpi);
+    return m_error;
 }
 
 int64_t DiskIO::duration() const
@@ -91,38 +180,290 @@ int64_t DiskIO::duration() const
 
 size_t DiskIO::size() const
 {
-    if (m_fpi == nullptr)
+    if (m_fd == -1)
     {
         errno = EINVAL;
         return 0;
     }
 
-    struct stat stbuf;
-    fstat(fileno(m_fpi), &stbuf);
-    return static_cast<size_t>(stbuf.st_size);
+    return m_size;
 }
 
 size_t DiskIO::tell() const
 {
-    return static_cast<size_t>(ftell(m_fpi));
+    return m_pos;
 }
 
 int DiskIO::seek(int64_t offset, int whence)
 {
-    return fseek(m_fpi, static_cast<long int>(offset), whence);
+    int64_t pos;
+
+    switch (whence)
+    {
+    case SEEK_SET:
+    {
+        pos = offset;
+        break;
+    }
+    case SEEK_CUR:
+    {
+        pos = static_cast<int64_t>(m_pos) + offset;
+        break;
+    }
+    case SEEK_END:
+    {
+        pos = static_cast<int64_t>(m_size) + offset;
+        break;
+    }
+    default:
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    }
+
+    if (m_fd == -1 || pos < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    m_pos   = static_cast<size_t>(pos);
+    m_eof   = false;
+
+    // Sequential read ahead starts over after a seek, get the first block on its way
+    readahead();
+
+    return 0;
 }
 
 bool DiskIO::eof() const
 {
-    return feof(m_fpi) ? true : false;
+    return m_eof;
 }
 
 void DiskIO::close()
 {
-    FILE *fpi = m_fpi;
-    if (fpi != nullptr)
+    int fd = m_fd;
+    if (fd != -1)
+    {
+#ifdef USE_LIBURING
+        uring_drain();
+        uring_exit();
+#endif // USE_LIBURING
+        m_fd = -1;
+        ::close(fd);
+    }
+}
+
+void DiskIO::readahead() const
+{
+    if (m_pos < m_size)
+    {
+        posix_fadvise(m_fd, static_cast<off_t>(m_pos), static_cast<off_t>(bufsize()), POSIX_FADV_WILLNEED);
+    }
+}
+
+#ifdef USE_LIBURING
+bool DiskIO::uring_init()
+{
+    int ret = io_uring_queue_init(DISKIO_URING_DEPTH, &m_ring, 0);
+    if (ret < 0)
+    {
+        // Old kernel or blocked by seccomp
+        Logging::debug(filename(), "io_uring not available, reading synchronously: (%1) %2", -ret, strerror(-ret));
+        return false;
+    }
+
+    // Reads are consumed in the order they are queued, so slots can be used round robin
+    m_uring_buffer.resize(DISKIO_URING_DEPTH * bufsize());
+    m_uring_slot = 0;
+
+    return true;
+}
+
+void DiskIO::uring_submit()
+{
+    size_t next = m_reads.empty() ? m_pos : m_reads.back().m_pos + bufsize();
+    unsigned int queued = 0;
+
+    while (m_reads.size() < DISKIO_URING_DEPTH && next < m_size)
+    {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&m_ring);
+        if (sqe == nullptr)
+        {
+            break;
+        }
+
+        // Deque elements do not move when adding or removing at the ends, so the pointer stays valid
+        m_reads.emplace_back();
+        URING_READ & rd = m_reads.back();
+
+        rd.m_data       = m_uring_buffer.data() + m_uring_slot * bufsize();
+        rd.m_pos        = next;
+        rd.m_res        = 0;
+        rd.m_pending    = true;
+
+        io_uring_prep_read(sqe, m_fd, rd.m_data, static_cast<unsigned int>(bufsize()), static_cast<off_t>(rd.m_pos));
+        io_uring_sqe_set_data(sqe, &rd);
+
+        m_uring_slot = (m_uring_slot + 1) % DISKIO_URING_DEPTH;
+
+        next += bufsize();
+        queued++;
+    }
+
+    if (queued)
+    {
+        // Reads not taken here are submitted by io_uring_submit_and_wait() in uring_wait()
+        int ret = io_uring_submit(&m_ring);
+        if (ret < 0 && ret != -EAGAIN && ret != -EBUSY && ret != -EINTR)
+        {
+            // Will be retried, and reported to the reader, when waiting for the read
+            Logging::warning(filename(), "io_uring submit failed: (%1) %2", -ret, strerror(-ret));
+        }
+    }
+}
+
+bool DiskIO::uring_wait(URING_READ & rd)
+{
+    while (rd.m_pending)
     {
-        m_fpi = nullptr;
-        fclose(fpi);
+        struct io_uring_cqe *cqe;
+        int ret = io_uring_peek_cqe(&m_ring, &cqe);
+
+        if (ret == -EAGAIN)
+        {
+            ret = io_uring_submit_and_wait(&m_ring, 1);
+            if (ret < 0 && ret != -EAGAIN && ret != -EBUSY && ret != -EINTR)
+            {
+                Logging::error(filename(), "io_uring wait failed: (%1) %2", -ret, strerror(-ret));
+                m_error = errno = -ret;
+                return false;
+            }
+            continue;
+        }
+
+        if (ret < 0)
+        {
+            Logging::error(filename(), "io_uring completion failed: (%1) %2", -ret, strerror(-ret));
+            m_error = errno = -ret;
+            return false;
+        }
+
+        URING_READ * done = static_cast<URING_READ *>(io_uring_cqe_get_data(cqe));
+        done->m_res     = cqe->res;
+        done->m_pending = false;
+        io_uring_cqe_seen(&m_ring, cqe);
     }
+
+    return true;
+}
+
+void DiskIO::uring_drain()
+{
+    for (URING_READ & rd : m_reads)
+    {
+        if (!uring_wait(rd))
+        {
+            // Tearing down the ring cancels what is still in flight
+            uring_exit();
+            return;
+        }
+    }
+    m_reads.clear();
+}
+
+void DiskIO::uring_exit()
+{
+    if (m_uring)
+    {
+        m_uring = false;
+        io_uring_queue_exit(&m_ring);
+    }
+    m_reads.clear();
+    m_uring_buffer.clear();
+    m_uring_buffer.shrink_to_fit();
+}
+
+size_t DiskIO::uring_read(void * data, size_t size)
+{
+    size_t result_len = 0;
+
+    while (result_len < size)
+    {
+        // Skip blocks already consumed, start over if the position is outside the queued blocks (after a seek or a short read)
+        while (!m_reads.empty())
+        {
+            URING_READ & rd = m_reads.front();
+
+            if (m_pos < rd.m_pos)
+            {
+                uring_drain();
+                break;
+            }
+
+            if (!uring_wait(rd))
+            {
+                uring_drain();
+                return result_len;
+            }
+
+            if (m_pos < rd.m_pos + static_cast<size_t>(std::max(rd.m_res, static_cast<ssize_t>(0))) || (rd.m_res <= 0 && m_pos == rd.m_pos))
+            {
+                break;
+            }
+
+            m_reads.pop_front();
+        }
+
+        if (m_uring)
+        {
+            uring_submit();
+        }
+
+        if (!m_uring || m_reads.empty())
+        {
+            // Shut down on error, or at the end of the file as far as known: let pread() tell for sure
+            return result_len + pread_all(static_cast<uint8_t *>(data) + result_len, size - result_len);
+        }
+
+        URING_READ & rd = m_reads.front();
+
+        if (!uring_wait(rd))
+        {
+            uring_drain();
+            break;
+        }
+
+        if (rd.m_res < 0)
+        {
+            m_error = errno = static_cast<int>(-rd.m_res);
+            uring_drain();
+            break;
+        }
+
+        if (!rd.m_res)
+        {
+            m_eof = true;
+            break;
+        }
+
+        size_t offset   = m_pos - rd.m_pos;
+        size_t bytes    = std::min(size - result_len, static_cast<size_t>(rd.m_res) - offset);
+
+        memcpy(static_cast<uint8_t *>(data) + result_len, rd.m_data + offset, bytes);
+
+        m_pos       += bytes;
+        result_len  += bytes;
+
+        if (offset + bytes >= static_cast<size_t>(rd.m_res))
+        {
+            // A short block is not necessarily the last one. The next queued block then starts behind m_pos and is read again.
+            m_reads.pop_front();
+        }
+    }
+
+    return result_len;
 }
+#endif // USE_LIBURING
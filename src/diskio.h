@@ -38,7 +38,19 @@
 
 #include "fileio.h"
 
+#ifdef USE_LIBURING
+#include <liburing.h>
+#include <deque>
+#endif // USE_LIBURING
+
 /** @brief Disk file I/O class
+ *
+ * Reads with pread() in blocks of --io_block_size bytes, and tells the
+ * kernel about the access pattern with posix_fadvise() so that read
+ * ahead is done. The file size is taken once on open.
+ *
+ * If built with liburing, the next blocks are read through io_uring
+ * instead, keeping several reads in flight.
  */
 class DiskIO : public FileIO
 {
@@ -117,7 +129,73 @@ public:
     virtual void    close();
 
 protected:
-    FILE *          m_fpi;                                      /**< @brief File pointer to source media */
+    /**
+     * @brief Ask the kernel to read the next block ahead.
+     */
+    void            readahead() const;
+    /**
+     * @brief Read with pread() until size bytes have been read or the end of file is reached.
+     * @param[out] data - buffer to store read bytes in. Must be large enough to hold up to size bytes.
+     * @param[in] size - number of bytes to read
+     * @return Returns the number of bytes read, less than size only at end of file or on error.
+     */
+    size_t          pread_all(void *data, size_t size);
+#ifdef USE_LIBURING
+    /**
+     * @brief Read submitted to io_uring
+     */
+    typedef struct URING_READ
+    {
+        uint8_t *               m_data;                         /**< @brief Read buffer, a slot of m_uring_buffer */
+        size_t                  m_pos;                          /**< @brief File position of read */
+        ssize_t                 m_res;                          /**< @brief Number of bytes read, or -errno */
+        bool                    m_pending;                      /**< @brief Read has been submitted but not completed yet */
+    } URING_READ;
+
+    /**
+     * @brief Set up the io_uring.
+     * @return Returns true on success, false if io_uring is not available. Reads are done with pread() then.
+     */
+    bool            uring_init();
+    /**
+     * @brief Submit reads for the blocks following the last one queued, up to DISKIO_URING_DEPTH.
+     */
+    void            uring_submit();
+    /**
+     * @brief Wait until a read has completed.
+     * @param[in] rd - Read to wait for.
+     * @return Returns true on success, false on error. m_error will be set.
+     */
+    bool            uring_wait(URING_READ & rd);
+    /**
+     * @brief Wait for all reads in flight and discard them.
+     */
+    void            uring_drain();
+    /**
+     * @brief Shut down the io_uring.
+     */
+    void            uring_exit();
+    /**
+     * @brief Read data from the blocks read through io_uring.
+     * @param[out] data - buffer to store read bytes in. Must be large enough to hold up to size bytes.
+     * @param[in] size - number of bytes to read
+     * @return Returns the number of bytes read, less than size only at end of file or on error.
+     */
+    size_t          uring_read(void *data, size_t size);
+#endif // USE_LIBURING
+
+    int             m_fd;                                       /**< @brief File descriptor of source media */
+    size_t          m_pos;                                      /**< @brief Current read position */
+    size_t          m_size;                                     /**< @brief File size, determined on open */
+    int             m_error;                                    /**< @brief errno value of last read error, 0 if none */
+    bool            m_eof;                                      /**< @brief True if the last read hit the end of file */
+#ifdef USE_LIBURING
+    struct io_uring m_ring;                                     /**< @brief io_uring to submit reads to */
+    bool            m_uring;                                    /**< @brief True if m_ring is set up */
+    std::deque<URING_READ> m_reads;                             /**< @brief Reads queued, in file order */
+    std::vector<uint8_t> m_uring_buffer;                        /**< @brief Read buffers, one slot of bufsize() for each read in flight */
+    unsigned int    m_uring_slot;                               /**< @brief Slot of m_uring_buffer for the next read */
+#endif // USE_LIBURING
 };
 
 #endif // DISKIO_H
@@ -38,12 +38,67 @@
 
 #include <string.h>
 #include <assert.h>
+#include <algorithm>
 
 #include <dvdread/dvd_reader.h>
 #include <dvdread/nav_read.h>
 
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#define DVDIO_SESSION_IDLE_TIME 60      /**< @brief Seconds an unused disc session is kept open */
+
+/**
+ * @brief Key for the net size of a title or chapter: title, chapter, angle, full title
+ */
+typedef std::tuple<int, int, int, bool> DVDSIZEKEY;
+
+/**
+ * @brief Disc session, shared between all DvdIO objects of the same disc
+ */
+struct DVDSESSION
+{
+    std::string                         m_path;             /**< @brief Path to DVD */
+    unsigned int                        m_refcount;         /**< @brief Number of DvdIO objects using this session */
+    time_t                              m_last_used;        /**< @brief Time the session was released last */
+    dvd_reader_t *                      m_dvd;              /**< @brief DVD reader handle */
+    ifo_handle_t *                      m_vmg_file;         /**< @brief DVD video manager handle */
+    std::map<int, ifo_handle_t *>       m_vts_files;        /**< @brief Info files by title set */
+    std::map<int, dvd_file_t *>         m_title_files;      /**< @brief VOB files by title set */
+    std::map<DVDSIZEKEY, size_t>        m_sizes;            /**< @brief Net sizes already determined */
+    std::mutex                          m_mutex;            /**< @brief Access mutex, libdvdread handles are not thread safe */
+};
+
+static std::map<std::string, DVDSESSION *> dvd_sessions;    /**< @brief Open disc sessions by path */
+static std::mutex               dvd_sessions_mutex;         /**< @brief Access mutex for dvd_sessions */
+
+static void session_free(DVDSESSION * session);
+
+/**
+ * @brief Close a disc session and free it.
+ * @param[in] session - Session to free.
+ */
+static void session_free(DVDSESSION * session)
+{
+    Logging::debug(session->m_path, "Closing DVD session.");
+
+    for (std::pair<const int, dvd_file_t *> & title_file : session->m_title_files)
+    {
+        DVDCloseFile(title_file.second);
+    }
+    for (std::pair<const int, ifo_handle_t *> & vts_file : session->m_vts_files)
+    {
+        ifoClose(vts_file.second);
+    }
+    ifoClose(session->m_vmg_file);
+    DVDClose(session->m_dvd);
+    delete session;
+}
+
 DvdIO::DvdIO()
-    : m_dvd(nullptr)
+    : m_session(nullptr)
+    , m_dvd(nullptr)
     , m_dvd_title(nullptr)
     , m_vmg_file(nullptr)
     , m_vts_file(nullptr)
@@ -59,6 +114,8 @@ DvdIO::DvdIO()
     , m_rest_size(0)
     , m_rest_pos(0)
     , m_cur_pos(0)
+    , m_buf_first(0)
+    , m_buf_blocks(0)
     , m_full_title(false)
     , m_title_idx(0)
     , m_chapter_idx(0)
@@ -113,23 +170,15 @@ int DvdIO::open(LPVIRTUALFILE virtualfile)
 
     Logging::debug(path(), "Opening input DVD.");
 
-    // Open the disc.
-    m_dvd = DVDOpen(path().c_str());
-    if (!m_dvd)
-    {
-        Logging::error(path(), "Couldn't open DVD.");
-        return EINVAL;
-    }
-
-    // Load the video manager to find out the information about the titles on this disc.
-    m_vmg_file = ifoOpen(m_dvd, 0);
-    if (!m_vmg_file)
+    // Open the disc and load the video manager, or get them from another chapter of this disc.
+    m_session = session_open(path());
+    if (m_session == nullptr)
     {
-        Logging::error(path(), "Can't open VMG info.");
-        DVDClose(m_dvd);
         return EINVAL;
     }
-    tt_srpt = m_vmg_file->tt_srpt;
+    m_dvd       = m_session->m_dvd;
+    m_vmg_file  = m_session->m_vmg_file;
+    tt_srpt     = m_vmg_file->tt_srpt;
 
     // Make sure our title number is valid.
     Logging::trace(path(), "There are %1 titles on this DVD.", static_cast<uint16_t>(tt_srpt->nr_of_srpts));
@@ -137,8 +186,7 @@ int DvdIO::open(LPVIRTUALFILE virtualfile)
     if (m_title_idx < 0 || m_title_idx >= tt_srpt->nr_of_srpts)
     {
         Logging::error(path(), "Invalid title %1.", m_title_idx + 1);
-        ifoClose(m_vmg_file);
-        DVDClose(m_dvd);
+        close();
         return EINVAL;
     }
 
@@ -148,8 +196,7 @@ int DvdIO::open(LPVIRTUALFILE virtualfile)
     if (m_chapter_idx < 0 || m_chapter_idx >= tt_srpt->title[m_title_idx].nr_of_ptts)
     {
         Logging::error(path(), "Invalid chapter %1", m_chapter_idx + 1);
-        ifoClose(m_vmg_file);
-        DVDClose(m_dvd);
+        close();
         return EINVAL;
     }
 
@@ -159,18 +206,16 @@ int DvdIO::open(LPVIRTUALFILE virtualfile)
     if (m_angle_idx < 0 || m_angle_idx >= tt_srpt->title[m_title_idx].nr_of_angles)
     {
         Logging::error(nullptr, "Invalid angle %1", m_angle_idx + 1);
-        ifoClose(m_vmg_file);
-        DVDClose(m_dvd);
+        close();
         return EINVAL;
     }
 
     // Load the VTS information for the title set our title is in.
-    m_vts_file = ifoOpen(m_dvd, tt_srpt->title[m_title_idx].title_set_nr);
+    m_vts_file = session_vts(tt_srpt->title[m_title_idx].title_set_nr);
     if (!m_vts_file)
     {
         Logging::error(path(), "Can't open the title %1 info file.", tt_srpt->title[m_title_idx].title_set_nr);
-        ifoClose(m_vmg_file);
-        DVDClose(m_dvd);
+        close();
         return EINVAL;
     }
 
@@ -192,28 +237,47 @@ int DvdIO::open(LPVIRTUALFILE virtualfile)
     }
 
     // We've got enough info, time to open the title set data.
-    m_dvd_title = DVDOpenFile(m_dvd, tt_srpt->title[m_title_idx].title_set_nr, DVD_READ_TITLE_VOBS);
+    m_dvd_title = session_title(tt_srpt->title[m_title_idx].title_set_nr);
     if (!m_dvd_title)
     {
         Logging::error(path(), "Can't open title VOBS (VTS_%<%02d>1_1.VOB).", tt_srpt->title[m_title_idx].title_set_nr);
-        ifoClose(m_vts_file);
-        ifoClose(m_vmg_file);
-        DVDClose(m_dvd);
+        close();
         return EINVAL;
     }
 
     rewind();
 
-    // Determine the net file size
-    m_size = 0;
-    size_t bytes_read;
+    // Determine the net file size. This requires to demux the whole chapter, only do it once per disc session.
+    DVDSIZEKEY sizekey(m_title_idx, m_chapter_idx, m_angle_idx, m_full_title);
+    bool known_size;
 
-    while ((bytes_read = read(nullptr, ULONG_MAX)) != 0 && !eof())
     {
-        m_size += bytes_read;
+        std::lock_guard<std::mutex> lock(m_session->m_mutex);
+        std::map<DVDSIZEKEY, size_t>::const_iterator it = m_session->m_sizes.find(sizekey);
+
+        known_size = (it != m_session->m_sizes.end());
+        m_size = known_size ? it->second : 0;
     }
 
-    rewind();
+    if (!known_size)
+    {
+        size_t bytes_read;
+
+        // The last read may already reach the end of the chapter, count it before checking for EOF.
+        do
+        {
+            bytes_read = read(nullptr, ULONG_MAX);
+            m_size += bytes_read;
+        }
+        while (bytes_read != 0 && !eof());
+
+        rewind();
+
+        std::lock_guard<std::mutex> lock(m_session->m_mutex);
+        m_session->m_sizes[sizekey] = m_size;
+    }
+
+    Logging::trace(path(), "Net size of title %1 chapter %2: %3 bytes.", m_title_idx + 1, m_chapter_idx + 1, m_size);
 
     return 0;
 }
@@ -553,144 +617,164 @@ void DvdIO::next_cell()
 
 size_t DvdIO::read(void * data, size_t size)
 {
-    size_t cur_output_size;
-    ssize_t maxlen;
     size_t result_len = 0;
-    DSITYPE dsitype;
 
-    if (data != nullptr && m_rest_size)
+    // Fill the buffer with as many VOBUs as fit. Leftovers of the last one are kept for the next call.
+    while (result_len < size)
     {
-        size_t rest_size = m_rest_size;
-
-        assert(rest_size < size);
+        if (!m_rest_size)
+        {
+            if (m_is_eof || !read_vobu())
+            {
+                break;
+            }
+        }
 
-        memcpy(data, &m_data[m_rest_pos], rest_size);
+        size_t len = std::min(size - result_len, m_rest_size);
 
-        m_rest_size = m_rest_pos = 0;
+        if (data != nullptr)
+        {
+            memcpy(static_cast<uint8_t *>(data) + result_len, &m_data[m_rest_pos], len);
+        }
 
-        return rest_size;
+        m_rest_pos  += len;
+        m_rest_size -= len;
+        result_len  += len;
     }
 
+    m_cur_pos += result_len;
+
+    return result_len;
+}
+
+bool DvdIO::read_vobu()
+{
+    size_t cur_output_size;
+    DSITYPE dsitype;
+    dsi_t dsi_pack;
+    unsigned int next_block;
+    uint8_t * buffer;
+
+    m_rest_size = m_rest_pos = 0;
+
     // Playback by cell in this pgc, starting at the cell for our chapter.
-    //while (next_cell < last_cell)
+    if (m_goto_next_cell)
     {
-        if (m_goto_next_cell)
-        {
-            m_goto_next_cell = false;
+        m_goto_next_cell = false;
 
-            m_cur_cell = m_next_cell;
+        m_cur_cell = m_next_cell;
 
-            next_cell();
+        next_cell();
 
-            m_cur_block = m_cur_pgc->cell_playback[m_cur_cell].first_sector;
-        }
+        m_cur_block = m_cur_pgc->cell_playback[m_cur_cell].first_sector;
+    }
 
-        if (m_cur_block >= m_cur_pgc->cell_playback[m_cur_cell].last_sector)
-        {
-            m_is_eof = false;
-            return 0;
-        }
+    if (m_cur_block >= m_cur_pgc->cell_playback[m_cur_cell].last_sector)
+    {
+        m_is_eof = false;
+        return false;
+    }
 
-        // We loop until we're out of this cell.
-        //for(cur_pack = cur_pgc->cell_playback[cur_cell].first_sector;
-        //     cur_pack < cur_pgc->cell_playback[cur_cell].last_sector;)
-        {
-            dsi_t dsi_pack;
-            unsigned int next_block;
+    // Read NAV packet.
+    buffer = read_blocks(m_cur_block, 1);
+    if (buffer == nullptr)
+    {
+        Logging::error(path(), "Read failed for block at %1", m_cur_block);
+        m_errno = EIO;
+        return false;
+    }
 
-            // Read NAV packet.
-            maxlen = DVDReadBlocks(m_dvd_title, static_cast<int>(m_cur_block), 1, m_buffer);
-            if (maxlen != 1)
-            {
-                Logging::error(path(), "Read failed for block at %1", m_cur_block);
-                m_errno = EIO;
-                return 0;
-            }
+    if (!is_nav_pack(buffer))
+    {
+        Logging::warning(path(), "Block at %1 is probably not a NAV packet. Transcode may fail.", m_cur_block);
+    }
 
-            if (!is_nav_pack(m_buffer))
-            {
-                Logging::warning(path(), "Block at %1 is probably not a NAV packet. Transcode may fail.", m_cur_block);
-            }
+    // Parse the contained dsi packet.
+    dsitype = handle_DSI(&dsi_pack, &cur_output_size, &next_block, buffer);
+    if (m_cur_block != dsi_pack.dsi_gi.nv_pck_lbn)
+    {
+        Logging::error(path(), "Read failed at %1 because current block != dsi_pack.dsi_gi.nv_pck_lbn", m_cur_block);
+        m_errno = EIO;
+        return false;
+    }
 
-            // Parse the contained dsi packet.
-            dsitype = handle_DSI(&dsi_pack, &cur_output_size, &next_block, m_buffer);
-            if (m_cur_block != dsi_pack.dsi_gi.nv_pck_lbn)
-            {
-                Logging::error(path(), "Read failed at %1 because current block != dsi_pack.dsi_gi.nv_pck_lbn", m_cur_block);
-                m_errno = EIO;
-                return 0;
-            }
+    if (cur_output_size >= DVDIO_MAX_BLOCKS)
+    {
+        Logging::error(path(), "Read failed at %1 because current output size %2 >= %3", m_cur_block, cur_output_size, DVDIO_MAX_BLOCKS);
+        m_errno = EIO;
+        return false;
+    }
 
-            if (cur_output_size >= 1024)
-            {
-                Logging::error(path(), "Read failed at %1 because current output size %2 >= 1024", m_cur_block, cur_output_size);
-                m_errno = EIO;
-                return 0;
-            }
+    m_cur_block++;
 
-            m_cur_block++;
+    // Get cur_output_size packs, usually from the same read as the NAV packet.
+    buffer = read_blocks(m_cur_block, cur_output_size);
+    if (buffer == nullptr)
+    {
+        Logging::error(path(), "Read failed for %1 blocks at %2", cur_output_size, m_cur_block);
+        m_errno = EIO;
+        return false;
+    }
 
-            // Read in and output cur_output_size packs.
-            maxlen = DVDReadBlocks(m_dvd_title, static_cast<int>(m_cur_block), cur_output_size, m_buffer);
+    m_rest_size = demux_pes(m_data, buffer, cur_output_size * DVD_VIDEO_LB_LEN);
 
-            if (maxlen != static_cast<int>(cur_output_size))
-            {
-                Logging::error(path(), "Read failed for %1 blocks at %2", cur_output_size, m_cur_block);
-                m_errno = EIO;
-                return 0;
-            }
+    m_cur_block = next_block;
 
-            size_t netsize = cur_output_size * DVD_VIDEO_LB_LEN;
+    // DSITYPE_EOF_TITLE - end of title
+    // DSITYPE_EOF_CHAPTER - end of chapter
+    if ((dsitype != DSITYPE_CONTINUE && !m_full_title) ||   // Stop at end of chapter/title
+            (dsitype == DSITYPE_EOF_TITLE))                 // Stop at end of title
+    {
+        m_is_eof = true;
+    }
 
-            netsize = demux_pes(m_data, m_buffer, netsize);
+    return true;
+}
 
-            if (data != nullptr)
-            {
-                if (netsize > size)
-                {
-                    result_len = size;
+uint8_t * DvdIO::read_blocks(unsigned int block, size_t count)
+{
+    if (m_buf_blocks && block >= m_buf_first && block + count <= m_buf_first + m_buf_blocks)
+    {
+        // Already read
+        return &m_buffer[(block - m_buf_first) * DVD_VIDEO_LB_LEN];
+    }
 
-                    memcpy(data, m_data, result_len);
+    // Read ahead up to the end of the cell, in one go. Usually covers many VOBUs.
+    size_t blocks = DVDIO_MAX_BLOCKS;
+    unsigned int last_sector = m_cur_pgc->cell_playback[m_cur_cell].last_sector;
 
-                    m_rest_size = netsize - size;
-                    m_rest_pos = size;
-                }
-                else
-                {
-                    result_len = netsize;
+    if (block <= last_sector && last_sector - block + 1 < blocks)
+    {
+        blocks = std::max(count, static_cast<size_t>(last_sector - block + 1));
+    }
 
-                    memcpy(data, m_data, result_len);
-                }
-            }
-            else
-            {
-                if (netsize > size)
-                {
-                    result_len = size;
-                }
-                else
-                {
-                    result_len = netsize;
-                }
-            }
+    ssize_t maxlen;
 
-            m_cur_block = next_block;
-        }
+    {
+        // The title file and the reader may be shared with other chapters of the disc. libdvdread
+        // seeks and reads on the device handle of the reader, so reads of different chapters of
+        // the same disc are serialised.
+        std::lock_guard<std::mutex> lock(m_session->m_mutex);
+
+        maxlen = DVDReadBlocks(m_dvd_title, static_cast<int>(block), blocks, m_buffer);
 
-        //break;
+        if (maxlen < static_cast<ssize_t>(count) && blocks > count)
+        {
+            // Maybe read beyond the end of the title file, try what is really required
+            maxlen = DVDReadBlocks(m_dvd_title, static_cast<int>(block), count, m_buffer);
+        }
     }
 
-    // DSITYPE_EOF_TITLE - end of title
-    // DSITYPE_EOF_CHAPTER - end of chapter
-    if ((dsitype != DSITYPE_CONTINUE && !m_full_title) ||   // Stop at end of chapter/title
-            (dsitype == DSITYPE_EOF_TITLE))                 // Stop at end of title
+    if (maxlen < static_cast<ssize_t>(count))
     {
-        m_is_eof = true;
+        m_buf_blocks = 0;
+        return nullptr;
     }
 
-    m_cur_pos += result_len;
+    m_buf_first     = block;
+    m_buf_blocks    = static_cast<size_t>(maxlen);
 
-    return result_len;
+    return m_buffer;
 }
 
 int DvdIO::error() const
@@ -771,10 +855,17 @@ int DvdIO::seek(int64_t offset, int whence)
     }
 
     size_t total_read = 0;
-    size_t bytes_read;
-    while ((bytes_read = read(nullptr, abs_offset - total_read - cur_pos)) != 0 && total_read < abs_offset && !eof())
+    while (cur_pos + total_read < abs_offset)
     {
+        size_t bytes_read = read(nullptr, abs_offset - total_read - cur_pos);
+
+        // Count the last read even if it reached the end of the chapter
         total_read += bytes_read;
+
+        if (!bytes_read || eof())
+        {
+            break;
+        }
     }
 
     if (total_read)
@@ -788,32 +879,160 @@ int DvdIO::seek(int64_t offset, int whence)
 
 bool DvdIO::eof() const
 {
-    return m_is_eof;
+    return (m_is_eof && !m_rest_size);
 }
 
 void DvdIO::close()
 {
-    if (m_vts_file != nullptr)
+    // Handles are owned by the session
+    m_vts_file      = nullptr;
+    m_vmg_file      = nullptr;
+    m_dvd_title     = nullptr;
+    m_dvd           = nullptr;
+    m_buf_blocks    = 0;
+
+    if (m_session != nullptr)
     {
-        ifoClose(m_vts_file);
-        m_vts_file = nullptr;
+        session_close(m_session);
+        m_session = nullptr;
     }
-    if (m_vmg_file != nullptr)
+}
+
+DVDSESSION * DvdIO::session_open(const std::string & path)
+{
+    std::lock_guard<std::mutex> lock(dvd_sessions_mutex);
+
+    std::map<std::string, DVDSESSION *>::iterator it = dvd_sessions.find(path);
+    if (it != dvd_sessions.end())
     {
-        ifoClose(m_vmg_file);
-        m_vmg_file = nullptr;
+        DVDSESSION * session = it->second;
+
+        if (session->m_refcount || time(nullptr) - session->m_last_used < DVDIO_SESSION_IDLE_TIME)
+        {
+            Logging::trace(path, "Sharing open DVD session.");
+            session->m_refcount++;
+            return session;
+        }
+
+        // Unused for a while, the disc may have been changed. Start over.
+        dvd_sessions.erase(it);
+        session_free(session);
     }
-    if (m_dvd_title != nullptr)
+
+    dvd_reader_t * dvd = DVDOpen(path.c_str());
+    if (!dvd)
     {
-        DVDCloseFile(m_dvd_title);
-        m_dvd_title = nullptr;
+        Logging::error(path, "Couldn't open DVD.");
+        return nullptr;
     }
-    if (m_dvd != nullptr)
+
+    // Load the video manager to find out the information about the titles on this disc.
+    ifo_handle_t * vmg_file = ifoOpen(dvd, 0);
+    if (!vmg_file)
     {
-        DVDClose(m_dvd);
-        m_dvd = nullptr;
+        Logging::error(path, "Can't open VMG info.");
+        DVDClose(dvd);
+        return nullptr;
     }
 
+    DVDSESSION * session = new (std::nothrow) DVDSESSION;
+    if (session == nullptr)
+    {
+        Logging::error(path, "Out of memory opening DVD session.");
+        ifoClose(vmg_file);
+        DVDClose(dvd);
+        return nullptr;
+    }
+
+    session->m_path         = path;
+    session->m_refcount     = 1;
+    session->m_last_used    = time(nullptr);
+    session->m_dvd          = dvd;
+    session->m_vmg_file     = vmg_file;
+
+    dvd_sessions.insert(std::make_pair(path, session));
+
+    return session;
+}
+
+void DvdIO::session_close(DVDSESSION * session)
+{
+    std::lock_guard<std::mutex> lock(dvd_sessions_mutex);
+
+    session->m_last_used = time(nullptr);
+
+    if (--session->m_refcount)
+    {
+        return;
+    }
+
+    // Keep this disc open for the next chapter, but no other unused disc
+    for (std::map<std::string, DVDSESSION *>::iterator it = dvd_sessions.begin(); it != dvd_sessions.end();)
+    {
+        if (it->second != session && !it->second->m_refcount)
+        {
+            session_free(it->second);
+            it = dvd_sessions.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+}
+
+void DvdIO::cleanup(bool all)
+{
+    std::lock_guard<std::mutex> lock(dvd_sessions_mutex);
+
+    for (std::map<std::string, DVDSESSION *>::iterator it = dvd_sessions.begin(); it != dvd_sessions.end();)
+    {
+        if (!it->second->m_refcount && (all || time(nullptr) - it->second->m_last_used >= DVDIO_SESSION_IDLE_TIME))
+        {
+            session_free(it->second);
+            it = dvd_sessions.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+}
+
+ifo_handle_t * DvdIO::session_vts(int title_set)
+{
+    std::lock_guard<std::mutex> lock(m_session->m_mutex);
+
+    std::map<int, ifo_handle_t *>::const_iterator it = m_session->m_vts_files.find(title_set);
+    if (it != m_session->m_vts_files.end())
+    {
+        return it->second;
+    }
+
+    ifo_handle_t * vts_file = ifoOpen(m_session->m_dvd, title_set);
+    if (vts_file != nullptr)
+    {
+        m_session->m_vts_files.insert(std::make_pair(title_set, vts_file));
+    }
+    return vts_file;
+}
+
+dvd_file_t * DvdIO::session_title(int title_set)
+{
+    std::lock_guard<std::mutex> lock(m_session->m_mutex);
+
+    std::map<int, dvd_file_t *>::const_iterator it = m_session->m_title_files.find(title_set);
+    if (it != m_session->m_title_files.end())
+    {
+        return it->second;
+    }
+
+    dvd_file_t * title_file = DVDOpenFile(m_session->m_dvd, title_set, DVD_READ_TITLE_VOBS);
+    if (title_file != nullptr)
+    {
+        m_session->m_title_files.insert(std::make_pair(title_set, title_file));
+    }
+    return title_file;
 }
 
 // Code nicked from Handbrake (https://github.com/HandBrake/HandBrake/blob/master/libhb/dvd.c)
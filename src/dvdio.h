@@ -42,6 +42,10 @@
 
 #include <dvdread/ifo_read.h>
 
+#define DVDIO_MAX_BLOCKS    1024        /**< @brief Max. number of blocks read at once, also the max. size of a VOBU */
+
+struct DVDSESSION;
+
 /** @brief DVD I/O class
  */
 class DvdIO : public FileIO
@@ -140,6 +144,11 @@ public:
      * @brief Close virtual file.
      */
     virtual void    close();
+    /**
+     * @brief Close disc sessions no longer used.
+     * @param[in] all - If true, close all unused sessions, otherwise only those unused for DVDIO_SESSION_IDLE_TIME seconds.
+     */
+    static void     cleanup(bool all);
 
 private:
     /**
@@ -180,6 +189,21 @@ private:
      * @return
      */
     DSITYPE         handle_DSI(void *_dsi_pack, size_t *cur_output_size, unsigned int * next_block, uint8_t *data);
+    /**
+     * @brief Read the next VOBU (Video Object Unit) and demux it into m_data.
+     *
+     * Sets m_rest_size to the number of bytes available and m_rest_pos to 0.
+     *
+     * @return Returns true if a VOBU was read (it may contain no data), false at end of cell or on error. m_errno is set on error.
+     */
+    bool            read_vobu();
+    /**
+     * @brief Get blocks from the title, reading ahead up to the end of the cell.
+     * @param[in] block - First block.
+     * @param[in] count - Number of blocks required.
+     * @return Pointer to the blocks in m_buffer, or nullptr on error.
+     */
+    uint8_t *       read_blocks(unsigned int block, size_t count);
     /**
      * @brief Goto next DVD cell
      */
@@ -188,12 +212,45 @@ private:
      * @brief Rewind to start of stream
      */
     void            rewind();
+    /**
+     * @brief Get the disc session for a path, open the disc if required.
+     *
+     * The disc reader and the info files are shared between all DvdIO objects of the
+     * same disc, so that transcoding several chapters at once or one after the other
+     * sets up the disc only once.
+     *
+     * @param[in] path - Path to DVD.
+     * @return Returns the session, or nullptr on error.
+     */
+    static DVDSESSION * session_open(const std::string & path);
+    /**
+     * @brief Release a disc session.
+     *
+     * The last disc session used is kept open when no longer used, the disc of
+     * a series of chapter files is opened only once this way.
+     *
+     * @param[in] session - Session as returned by session_open().
+     */
+    static void     session_close(DVDSESSION * session);
+    /**
+     * @brief Get the info file of a title set from the session, open it if required.
+     * @param[in] title_set - Title set number.
+     * @return Returns the info file, or nullptr on error.
+     */
+    ifo_handle_t *  session_vts(int title_set);
+    /**
+     * @brief Get the VOBs of a title set from the session, open them if required.
+     * @param[in] title_set - Title set number.
+     * @return Returns the VOB file handle, or nullptr on error.
+     */
+    dvd_file_t *    session_title(int title_set);
 
 protected:
-    dvd_reader_t *  m_dvd;                                      /**< @brief DVD reader handle */
-    dvd_file_t *    m_dvd_title;                                /**< @brief DVD title handle */
-    ifo_handle_t *  m_vmg_file;                                 /**< @brief DVD video manager handle */
-    ifo_handle_t *  m_vts_file;                                 /**< @brief DVD video title stream handle */
+    DVDSESSION *    m_session;                                  /**< @brief Disc session, shared with other DvdIO objects of the same disc */
+    dvd_reader_t *  m_dvd;                                      /**< @brief DVD reader handle, owned by m_session */
+    dvd_file_t *    m_dvd_title;                                /**< @brief DVD title handle, owned by m_session */
+    ifo_handle_t *  m_vmg_file;                                 /**< @brief DVD video manager handle, owned by m_session */
+    ifo_handle_t *  m_vts_file;                                 /**< @brief DVD video title stream handle, owned by m_session */
     pgc_t *         m_cur_pgc;                                  /**< @brief Current program chain */
     int             m_start_cell;                               /**< @brief Start cell */
     int             m_end_cell;                                 /**< @brief End cell (of title) */
@@ -206,14 +263,16 @@ protected:
     size_t          m_rest_size;                                /**< @brief Rest bytes in buffer */
     size_t          m_rest_pos;                                 /**< @brief Position in buffer */
     size_t          m_cur_pos;                                  /**< @brief Current position in virtual file */
+    unsigned int    m_buf_first;                                /**< @brief First block in m_buffer */
+    size_t          m_buf_blocks;                               /**< @brief Number of blocks in m_buffer, 0 if empty */
 
     bool            m_full_title;                               /**< @brief If true, ignore m_chapter_no and provide full track */
     int             m_title_idx;                                /**< @brief Track index (track number - 1) */
     int             m_chapter_idx;                              /**< @brief Chapter index (chapter number - 1) */
     int             m_angle_idx;                                /**< @brief Selected angle index (angle number -1) */
 
-    unsigned char   m_data[1024 * DVD_VIDEO_LB_LEN];            /**< @brief Buffer for read() data */
-    unsigned char   m_buffer[1024 * DVD_VIDEO_LB_LEN];          /**< @brief Buffer for data extracted from VOB file */
+    unsigned char   m_data[DVDIO_MAX_BLOCKS * DVD_VIDEO_LB_LEN];    /**< @brief Demuxed data of current VOBU */
+    unsigned char   m_buffer[DVDIO_MAX_BLOCKS * DVD_VIDEO_LB_LEN];  /**< @brief Blocks read from VOB file, starting at m_buf_first */
 
     int64_t         m_duration;                                 /**< @brief Track/chapter duration, in AV_TIME_BASE fractional seconds. */
     size_t          m_size;                                     /**< @brief Size of virtual file */
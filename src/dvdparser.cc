@@ -579,9 +579,19 @@ int check_dvd(const std::string & _path, void *buf, fuse_fill_dir_t filler)
     {
         if (!check_path(path))
         {
-            Logging::trace(path, "DVD detected.");
-            res = parse_dvd(path, &stbuf, buf, filler);
-            Logging::trace(path, "Found %1 titles.", res);
+            uint64_t stamp = disc_stamp(path);
+
+            res = load_disc(VIRTUALTYPE_DVD, path, stamp, &stbuf, buf, filler);
+            if (!res)
+            {
+                Logging::trace(path, "DVD detected.");
+                res = parse_dvd(path, &stbuf, buf, filler);
+                Logging::trace(path, "Found %1 titles.", res);
+                if (res > 0)
+                {
+                    save_disc(VIRTUALTYPE_DVD, path, stamp);
+                }
+            }
         }
         else
         {
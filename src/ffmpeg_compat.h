@@ -87,6 +87,12 @@
  *   av_get_codec_tag_string() from lavc.
  */
 #define LAVU_DEP_AV_GET_CODEC_TAG           (LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(55, 52, 0))
+/**
+ * 2021-09-20 - xxxxxxxxxx - lsws 6.1.100 - swscale.h @n
+ *   Add AVFrame-based scaling API and slice threading, enabled
+ *   with the "threads" option.
+ */
+#define LSWS_HAVE_THREADS                   (LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100))
 
 /**
  * Check for FFMPEG version 3+
@@ -32,6 +32,7 @@
 #include "ffmpeg_transcoder.h"
 #include "transcode.h"
 #include "buffer.h"
+#include "readaheadio.h"
 #include "wave.h"
 #include "logging.h"
 
@@ -63,6 +64,7 @@ extern "C" {
 #include <libavresample/avresample.h>
 #endif
 #include <libavutil/imgutils.h>
+#include <libavutil/buffer.h>
 #include <libavutil/opt.h>
 #include <libavutil/audio_fifo.h>
 #include <libavfilter/avfilter.h>
@@ -75,6 +77,12 @@ extern "C" {
 #pragma GCC diagnostic pop
 
 #define FRAME_SEEK_THRESHOLD    25  /**< @brief Ignore seek if target is within the next n frames */
+#define PICTURE_ALIGN           64  /**< @brief Line alignment of scaled pictures, wide enough for AVX2/AVX-512 */
+#define ADAPT_SPEED_HEADROOM    4   /**< @brief Switch to quality encoder settings if more than this number of segments ahead of the reader */
+#define ADAPT_SPEED_MIN_LEAD    1   /**< @brief Switch back to fast encoder settings if this number of segments or less ahead of the reader */
+#define MEMORY_CODEC_CTX        (1024 * 1024)   /**< @brief Estimated memory of an open codec context, without frame buffers */
+#define MEMORY_CODEC_FRAMES     16              /**< @brief Estimated number of frames (references, threads, lookahead) held by an open video codec */
+#define MEMORY_FILTER_FRAMES    4               /**< @brief Estimated number of frames held by the video filter graph */
 
 const FFmpeg_Transcoder::PRORES_BITRATE FFmpeg_Transcoder::m_prores_bitrate[] =
 {
@@ -168,7 +176,13 @@ FFmpeg_Transcoder::FFmpeg_Transcoder()
     , m_cur_channel_layout(0)
     , m_audio_resample_ctx(nullptr)
     , m_audio_fifo(nullptr)
+    , m_converted_samples(nullptr)
+    , m_converted_samples_max(0)
+    , m_audio_frame_pool(nullptr)
+    , m_audio_frame_pool_size(0)
     , m_sws_ctx(nullptr)
+    , m_picture_pool(nullptr)
+    , m_picture_pool_size(0)
     , m_buffer_sink_context(nullptr)
     , m_buffer_source_context(nullptr)
     , m_filter_graph(nullptr)
@@ -181,6 +195,7 @@ FFmpeg_Transcoder::FFmpeg_Transcoder()
     , m_buffer(nullptr)
     , m_reset_pts(false)
     , m_fake_frame_no(0)
+    , m_quality_mode(false)
 {
 #pragma GCC diagnostic pop
     Logging::trace(nullptr, "FFmpeg trancoder ready to initialise.");
@@ -292,6 +307,18 @@ int FFmpeg_Transcoder::open_input_file(LPVIRTUALFILE virtualfile, FileIO *fio)
         // Open new file io
         m_fileio = FileIO::alloc(m_virtualfile->m_type);
         m_close_fileio = true;  // do not close and delete
+
+        if (m_fileio != nullptr && params.m_readahead)
+        {
+            // Read input in a separate thread, takes ownership of m_fileio
+            FileIO * readahead = new(std::nothrow) ReadAheadIO(m_fileio, params.m_readahead);
+            if (readahead == nullptr)
+            {
+                delete m_fileio;
+                errno = ENOMEM;
+            }
+            m_fileio = readahead;
+        }
     }
     else
     {
@@ -1041,6 +1068,24 @@ int FFmpeg_Transcoder::prepare_codec(void *opt, FILETYPE filetype) const
     return ret;
 }
 
+void FFmpeg_Transcoder::set_quality_option(AVCodecContext *codec_ctx, const char *key, const char *value) const
+{
+    if (!m_quality_mode)
+    {
+        return;
+    }
+
+    int ret = av_opt_set(codec_ctx->priv_data, key, value, 0);
+    if (ret < 0)
+    {
+        // Not fatal, simply keep the profile settings
+        Logging::warning(destname(), "Could not set %1=%2 for quality mode (error '%3').", key, value, ffmpeg_geterror(ret).c_str());
+        return;
+    }
+
+    Logging::debug(destname(), "Quality mode: Set %1=%2.", key, value);
+}
+
 int FFmpeg_Transcoder::init_rescaler(AVPixelFormat in_pix_fmt, int in_width, int in_height, AVPixelFormat out_pix_fmt, int out_width, int out_height)
 {
     if (in_pix_fmt != out_pix_fmt || in_width != out_width || in_height != out_height)
@@ -1058,6 +1103,35 @@ int FFmpeg_Transcoder::init_rescaler(AVPixelFormat in_pix_fmt, int in_width, int
                            out_width, out_height);
         }
 
+#if LSWS_HAVE_THREADS
+        // Set up context by options to enable slice threading
+        m_sws_ctx = sws_alloc_context();
+        if (m_sws_ctx == nullptr)
+        {
+            Logging::error(destname(), "Could not allocate scaling/conversion context.");
+            return AVERROR(ENOMEM);
+        }
+
+        // Source settings
+        av_opt_set_int(m_sws_ctx, "srcw",       in_width, 0);
+        av_opt_set_int(m_sws_ctx, "srch",       in_height, 0);
+        av_opt_set_int(m_sws_ctx, "src_format", in_pix_fmt, 0);
+        // Target settings
+        av_opt_set_int(m_sws_ctx, "dstw",       out_width, 0);
+        av_opt_set_int(m_sws_ctx, "dsth",       out_height, 0);
+        av_opt_set_int(m_sws_ctx, "dst_format", out_pix_fmt, 0);
+        av_opt_set_int(m_sws_ctx, "sws_flags",  SWS_FAST_BILINEAR, 0);    // Maybe SWS_LANCZOS | SWS_ACCURATE_RND
+        av_opt_set_int(m_sws_ctx, "threads",    0, 0);                    // Automatic: one slice per CPU core
+
+        int ret = sws_init_context(m_sws_ctx, nullptr, nullptr);
+        if (ret < 0)
+        {
+            Logging::error(destname(), "Could not initialise scaling/conversion context (error '%1').", ffmpeg_geterror(ret).c_str());
+            sws_freeContext(m_sws_ctx);
+            m_sws_ctx = nullptr;
+            return ret;
+        }
+#else
         m_sws_ctx = sws_getContext(
                     // Source settings
                     in_width,               // width
@@ -1073,6 +1147,7 @@ int FFmpeg_Transcoder::init_rescaler(AVPixelFormat in_pix_fmt, int in_width, int
             Logging::error(destname(), "Could not allocate scaling/conversion context.");
             return AVERROR(ENOMEM);
         }
+#endif
     }
 
     return 0;
@@ -1370,6 +1445,8 @@ int FFmpeg_Transcoder::add_stream(AVCodecID codec_id)
                 return ret;
             }
 
+            set_quality_option(output_codec_ctx, "preset", "veryfast");
+
             // Set constant rate factor to avoid getting huge result files
             // The default is 23, but values between 30..40 create properly sized results. Possible values are 0 (lossless) to 51 (very small but ugly results).
             // ret = av_opt_set(output_codec_ctx->priv_data, "crf", "36", AV_OPT_SEARCH_CHILDREN);
@@ -1490,6 +1567,8 @@ int FFmpeg_Transcoder::add_stream(AVCodecID codec_id)
                 Logging::error(destname(), "Could not set profile for %1 output codec %2 (error '%3').", get_media_type_string(output_codec->type), get_codec_name(codec_id, false), ffmpeg_geterror(ret).c_str());
                 return ret;
             }
+
+            set_quality_option(output_codec_ctx, "cpu-used", "4");
             break;
         }
         case AV_CODEC_ID_PRORES:
@@ -2228,18 +2307,57 @@ AVFrame *FFmpeg_Transcoder::alloc_picture(AVPixelFormat pix_fmt, int width, int
     picture->width  = width;
     picture->height = height;
 
-    // allocate the buffers for the frame data
-    ret = av_frame_get_buffer(picture, 32);
-    if (ret < 0)
+    int size = av_image_get_buffer_size(pix_fmt, width, height, PICTURE_ALIGN);
+    if (size < 0)
+    {
+        Logging::error(destname(), "Could not allocate frame data (error '%1').", ffmpeg_geterror(size).c_str());
+        av_frame_free(&picture);
+        return nullptr;
+    }
+
+    // Get the buffers for the frame data. av_malloc() may align to less than PICTURE_ALIGN, so leave room to align the start.
+    picture->buf[0] = get_pool_buffer(&m_picture_pool, &m_picture_pool_size, size + PICTURE_ALIGN - 1);
+    if (picture->buf[0] == nullptr)
     {
         Logging::error(destname(), "Could not allocate frame data.");
         av_frame_free(&picture);
         return nullptr;
     }
 
+    uint8_t *data = reinterpret_cast<uint8_t *>(FFALIGN(reinterpret_cast<uintptr_t>(picture->buf[0]->data), PICTURE_ALIGN));
+
+    ret = av_image_fill_arrays(picture->data, picture->linesize, data, pix_fmt, width, height, PICTURE_ALIGN);
+    if (ret < 0)
+    {
+        Logging::error(destname(), "Could not allocate frame data (error '%1').", ffmpeg_geterror(ret).c_str());
+        av_frame_free(&picture);
+        return nullptr;
+    }
+
+    picture->extended_data = picture->data;
+
     return picture;
 }
 
+AVBufferRef *FFmpeg_Transcoder::get_pool_buffer(AVBufferPool **pool, int *pool_size, int size)
+{
+    if (*pool == nullptr || *pool_size < size)
+    {
+        // Buffers still in use will be freed by the old pool when they are returned
+        av_buffer_pool_uninit(pool);
+
+        *pool = av_buffer_pool_init(size, nullptr);
+        if (*pool == nullptr)
+        {
+            *pool_size = 0;
+            return nullptr;
+        }
+        *pool_size = size;
+    }
+
+    return av_buffer_pool_get(*pool);
+}
+
 #if LAVC_NEW_PACKET_INTERFACE
 int FFmpeg_Transcoder::decode(AVCodecContext *avctx, AVFrame *frame, int *got_frame, const AVPacket *pkt) const
 {
@@ -2362,15 +2480,6 @@ int FFmpeg_Transcoder::decode_audio_frame(AVPacket *pkt, int *decoded)
         // If there is decoded data, convert and store it
         if (data_present && frame->nb_samples)
         {
-            // Temporary storage for the converted input samples.
-            uint8_t **converted_input_samples = nullptr;
-            int nb_output_samples;
-#if LAVR_DEPRECATE
-            nb_output_samples = (m_audio_resample_ctx != nullptr) ? swr_get_out_samples(m_audio_resample_ctx, frame->nb_samples) : frame->nb_samples;
-#else
-            nb_output_samples = (m_audio_resample_ctx != nullptr) ? avresample_get_out_samples(m_audio_resample_ctx, frame->nb_samples) : frame->nb_samples;
-#endif
-
             try
             {
                 // Initialise the resampler to be able to convert audio sample formats.
@@ -2380,27 +2489,48 @@ int FFmpeg_Transcoder::decode_audio_frame(AVPacket *pkt, int *decoded)
                     throw ret;
                 }
 
-                // Store audio frame
-                // Initialise the temporary storage for the converted input samples.
-                ret = init_converted_samples(&converted_input_samples, nb_output_samples);
-                if (ret < 0)
+                if (m_audio_resample_ctx == nullptr)
                 {
-                    throw ret;
+                    // Same format, rate and channel layout: no conversion required, so
+                    // store decoded samples directly instead of copying them first.
+                    ret = add_samples_to_fifo(frame->extended_data, frame->nb_samples);
+                    if (ret < 0)
+                    {
+                        throw ret;
+                    }
                 }
-
-                // Convert the input samples to the desired output sample format.
-                // This requires a temporary storage provided by converted_input_samples.
-                ret = convert_samples(frame->extended_data, frame->nb_samples, converted_input_samples, &nb_output_samples);
-                if (ret < 0)
+                else
                 {
-                    throw ret;
-                }
+                    // Temporary storage for the converted input samples.
+                    uint8_t **converted_input_samples = nullptr;
+#if LAVR_DEPRECATE
+                    int nb_output_samples = swr_get_out_samples(m_audio_resample_ctx, frame->nb_samples);
+#else
+                    int nb_output_samples = avresample_get_out_samples(m_audio_resample_ctx, frame->nb_samples);
+#endif
 
-                // Add the converted input samples to the FIFO buffer for later processing.
-                ret = add_samples_to_fifo(converted_input_samples, nb_output_samples);
-                if (ret < 0)
-                {
-                    throw ret;
+                    // Store audio frame
+                    // Initialise the temporary storage for the converted input samples.
+                    ret = init_converted_samples(&converted_input_samples, nb_output_samples);
+                    if (ret < 0)
+                    {
+                        throw ret;
+                    }
+
+                    // Convert the input samples to the desired output sample format.
+                    // This requires a temporary storage provided by converted_input_samples.
+                    ret = convert_samples(frame->extended_data, frame->nb_samples, converted_input_samples, &nb_output_samples);
+                    if (ret < 0)
+                    {
+                        throw ret;
+                    }
+
+                    // Add the converted input samples to the FIFO buffer for later processing.
+                    ret = add_samples_to_fifo(converted_input_samples, nb_output_samples);
+                    if (ret < 0)
+                    {
+                        throw ret;
+                    }
                 }
                 ret = 0;
             }
@@ -2408,12 +2538,6 @@ int FFmpeg_Transcoder::decode_audio_frame(AVPacket *pkt, int *decoded)
             {
                 ret = _ret;
             }
-
-            if (converted_input_samples != nullptr)
-            {
-                av_freep(&converted_input_samples[0]);
-                av_free(converted_input_samples);
-            }
         }
         av_frame_free(&frame);
     }
@@ -2545,10 +2669,23 @@ int FFmpeg_Transcoder::decode_video_frame(AVPacket *pkt, int *decoded)
                     return AVERROR(ENOMEM);
                 }
 
+#if LSWS_HAVE_THREADS
+                // Scales in slices on the threads of the context, sws_scale() would use only one
+                ret = sws_scale_frame(m_sws_ctx, tmp_frame, frame);
+                if (ret < 0)
+                {
+                    Logging::error(destname(), "Could not scale video frame (error '%1').", ffmpeg_geterror(ret).c_str());
+                    av_frame_free(&tmp_frame);
+                    av_frame_free(&frame);
+                    return ret;
+                }
+                ret = 0;
+#else
                 sws_scale(m_sws_ctx,
                           static_cast<const uint8_t * const *>(frame->data), frame->linesize,
                           0, frame->height,
                           tmp_frame->data, tmp_frame->linesize);
+#endif
 
                 tmp_frame->pts = frame->pts;
                 tmp_frame->best_effort_timestamp = frame->best_effort_timestamp;
@@ -2771,13 +2908,22 @@ int FFmpeg_Transcoder::init_converted_samples(uint8_t ***converted_input_samples
 {
     int ret;
 
+    if (m_converted_samples != nullptr && frame_size <= m_converted_samples_max)
+    {
+        // Big enough, reuse
+        *converted_input_samples = m_converted_samples;
+        return 0;
+    }
+
+    free_converted_samples();
+
     // Allocate as many pointers as there are audio channels.
     // Each pointer will later point to the audio samples of the corresponding
     // channels (although it may be nullptr for interleaved formats).
 
-    *converted_input_samples = static_cast<uint8_t **>(av_calloc(static_cast<size_t>(m_out.m_audio.m_codec_ctx->channels), sizeof(**converted_input_samples)));
+    m_converted_samples = static_cast<uint8_t **>(av_calloc(static_cast<size_t>(m_out.m_audio.m_codec_ctx->channels), sizeof(*m_converted_samples)));
 
-    if (*converted_input_samples == nullptr)
+    if (m_converted_samples == nullptr)
     {
         Logging::error(destname(), "Could not allocate converted input sample pointers.");
         return AVERROR(ENOMEM);
@@ -2785,20 +2931,35 @@ int FFmpeg_Transcoder::init_converted_samples(uint8_t ***converted_input_samples
 
     // Allocate memory for the samples of all channels in one consecutive
     // block for convenience.
-    ret = av_samples_alloc(*converted_input_samples, nullptr,
+    ret = av_samples_alloc(m_converted_samples, nullptr,
                            m_out.m_audio.m_codec_ctx->channels,
                            frame_size,
                            m_out.m_audio.m_codec_ctx->sample_fmt, 0);
     if (ret < 0)
     {
         Logging::error(destname(), "Could not allocate converted input samples (error '%1').", ffmpeg_geterror(ret).c_str());
-        av_freep(&(*converted_input_samples)[0]);
-        av_free(*converted_input_samples);
+        av_free(m_converted_samples);
+        m_converted_samples = nullptr;
         return ret;
     }
+
+    m_converted_samples_max     = frame_size;
+    *converted_input_samples    = m_converted_samples;
+
     return 0;
 }
 
+void FFmpeg_Transcoder::free_converted_samples()
+{
+    if (m_converted_samples != nullptr)
+    {
+        av_freep(&m_converted_samples[0]);
+        av_free(m_converted_samples);
+        m_converted_samples = nullptr;
+    }
+    m_converted_samples_max = 0;
+}
+
 #if LAVR_DEPRECATE
 int FFmpeg_Transcoder::convert_samples(uint8_t **input_data, int in_samples, uint8_t **converted_data, int *out_samples)
 {
@@ -3073,7 +3234,40 @@ int FFmpeg_Transcoder::init_audio_output_frame(AVFrame **frame, int frame_size)
     // Allocate the samples of the created frame. This call will make
     // sure that the audio frame can hold as many samples as specified.
 
-    ret = av_frame_get_buffer(*frame, 32);
+    int channels = m_out.m_audio.m_codec_ctx->channels;
+
+    if (av_sample_fmt_is_planar(m_out.m_audio.m_codec_ctx->sample_fmt) && channels > AV_NUM_DATA_POINTERS)
+    {
+        // Too many planes for frame->data, let FFmpeg handle extended_data.
+        ret = av_frame_get_buffer(*frame, 32);
+        if (ret < 0)
+        {
+            Logging::error(destname(), "Could allocate output frame samples (error '%1').", ffmpeg_geterror(ret).c_str());
+            av_frame_free(frame);
+            return ret;
+        }
+
+        return 0;
+    }
+
+    // Frames are all the same size except for the last, so recycle the sample buffers through a pool.
+    ret = av_samples_get_buffer_size(nullptr, channels, frame_size, m_out.m_audio.m_codec_ctx->sample_fmt, 32);
+    if (ret < 0)
+    {
+        Logging::error(destname(), "Could allocate output frame samples (error '%1').", ffmpeg_geterror(ret).c_str());
+        av_frame_free(frame);
+        return ret;
+    }
+
+    (*frame)->buf[0] = get_pool_buffer(&m_audio_frame_pool, &m_audio_frame_pool_size, ret);
+    if ((*frame)->buf[0] == nullptr)
+    {
+        Logging::error(destname(), "Could allocate output frame samples.");
+        av_frame_free(frame);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = av_samples_fill_arrays((*frame)->data, &(*frame)->linesize[0], (*frame)->buf[0]->data, channels, frame_size, m_out.m_audio.m_codec_ctx->sample_fmt, 32);
     if (ret < 0)
     {
         Logging::error(destname(), "Could allocate output frame samples (error '%1').", ffmpeg_geterror(ret).c_str());
@@ -3081,6 +3275,8 @@ int FFmpeg_Transcoder::init_audio_output_frame(AVFrame **frame, int frame_size)
         return ret;
     }
 
+    (*frame)->extended_data = (*frame)->data;
+
     return 0;
 }
 
@@ -3706,6 +3902,97 @@ int FFmpeg_Transcoder::skip_decoded_frames(uint32_t frame_no, bool forced_seek)
     return ret;
 }
 
+int FFmpeg_Transcoder::do_seek_segment(uint32_t segment_no)
+{
+    int ret;
+
+    m_reset_pts    = true;      // Note that we have to reset audio/video pts to the new position
+    m_have_seeked   = true;     // Note that we have seeked, thus skipped frames. We need to start transcoding over to fill any gaps.
+
+    int64_t pos = (segment_no - 1) * params.m_segment_duration;
+
+    if (m_in.m_video.m_stream_idx && m_out.m_video.m_stream_idx > -1)
+    {
+        int64_t pts = av_rescale_q(pos, av_get_time_base_q(), m_in.m_video.m_stream->time_base);
+
+        if (m_in.m_video.m_stream->start_time != AV_NOPTS_VALUE)
+        {
+            pts += m_in.m_video.m_stream->start_time;
+        }
+
+        ret = av_seek_frame(m_in.m_format_ctx, m_in.m_video.m_stream_idx, pts, AVSEEK_FLAG_BACKWARD);
+    }
+    else // if (m_out.m_audio.m_stream_idx > -1)
+    {
+        int64_t pts = av_rescale_q(pos, av_get_time_base_q(), m_in.m_audio.m_stream->time_base);
+
+        if (m_in.m_audio.m_stream->start_time != AV_NOPTS_VALUE)
+        {
+            pts += m_in.m_audio.m_stream->start_time;
+        }
+
+        ret = av_seek_frame(m_in.m_format_ctx, m_in.m_audio.m_stream_idx, pts, AVSEEK_FLAG_BACKWARD);
+    }
+
+    if (ret < 0)
+    {
+        Logging::error(destname(), "Seek failed on input file (error '%1').", ffmpeg_geterror(ret).c_str());
+        return ret;
+    }
+
+    if (m_in.m_audio.m_codec_ctx != nullptr)
+    {
+        avcodec_flush_buffers(m_in.m_audio.m_codec_ctx);
+    }
+
+    if (m_in.m_video.m_codec_ctx != nullptr)
+    {
+        avcodec_flush_buffers(m_in.m_video.m_codec_ctx);
+    }
+
+    close_output_file();
+
+    return open_output(m_buffer);
+}
+
+bool FFmpeg_Transcoder::adapt_encoder_speed(uint32_t segment_no)
+{
+    if (!params.m_adapt_speed || m_copy_video || m_out.m_video.m_codec_ctx == nullptr)
+    {
+        return false;
+    }
+
+    uint32_t read_segment = m_buffer->read_segment();
+    if (!read_segment)
+    {
+        // Nobody reads yet, nothing to compare with
+        return false;
+    }
+
+    int64_t lead = static_cast<int64_t>(segment_no) - static_cast<int64_t>(read_segment);
+    bool quality_mode = m_quality_mode;
+
+    if (lead > ADAPT_SPEED_HEADROOM)
+    {
+        quality_mode = true;
+    }
+    else if (lead <= ADAPT_SPEED_MIN_LEAD)
+    {
+        quality_mode = false;
+    }
+
+    if (quality_mode == m_quality_mode)
+    {
+        return false;
+    }
+
+    m_quality_mode = quality_mode;
+
+    Logging::info(destname(), "Transcoder is %1 segment(s) ahead of the reader, using %2 encoder settings from segment no. %3.", lead, m_quality_mode ? "quality" : "fast", segment_no);
+
+    return true;
+}
+
 int FFmpeg_Transcoder::process_single_fr(int &status)
 {
     int finished = 0;
@@ -3715,6 +4002,30 @@ int FFmpeg_Transcoder::process_single_fr(int &status)
 
     try
     {
+        if (is_hls() && m_buffer->is_segment_finished(m_current_segment))
+        {
+            // Resuming an earlier run: do not transcode the leading segments again.
+            uint32_t segment_no = m_buffer->next_unfinished_segment(m_current_segment);
+
+            if (segment_no)
+            {
+                Logging::info(destname(), "HLS segment no. %1 already complete, resuming at segment no. %2.", m_current_segment, segment_no);
+
+                ret = do_seek_segment(segment_no);
+                if (ret < 0)
+                {
+                    throw ret;
+                }
+
+                m_current_segment = segment_no;
+
+                if (!m_buffer->set_segment(m_current_segment))
+                {
+                    throw AVERROR(errno);
+                }
+            }
+        }
+
         if (m_in.m_video.m_stream != nullptr && is_frameset())
         {
             // Direct access handling for frame sets: seek to frame if requested.
@@ -3887,8 +4198,9 @@ int FFmpeg_Transcoder::process_single_fr(int &status)
             }
         }
 
-        if (!m_copy_video)
+        if (!m_copy_video && m_out.m_video.m_codec_ctx != nullptr)
         {
+            // Skipped for audio only targets
             while (!m_video_fifo.empty())
             {
                 AVFrame *output_frame = m_video_fifo.front();
@@ -3972,28 +4284,7 @@ int FFmpeg_Transcoder::process_single_fr(int &status)
         if (is_hls())
         {
             uint32_t next_segment;
-            int64_t pos = 0;
-            if (m_out.m_video_pts && m_in.m_video.m_stream != nullptr && m_out.m_video.m_stream != nullptr)
-            {
-                int64_t pts = m_out.m_video_pts;
-
-                if (m_in.m_video.m_stream->start_time != AV_NOPTS_VALUE)
-                {
-                    pts -= m_in.m_video.m_stream->start_time;
-                }
-
-                pos = av_rescale_q(pts, m_out.m_video.m_stream->time_base, av_get_time_base_q());
-            }
-            else if (m_out.m_audio_pts && m_in.m_audio.m_stream != nullptr && m_out.m_audio.m_stream != nullptr)
-            {
-                int64_t pts = m_out.m_audio_pts;
-
-                if (m_in.m_audio.m_stream->start_time != AV_NOPTS_VALUE)
-                {
-                    pts -= m_in.m_audio.m_stream->start_time;
-                }
-                pos = av_rescale_q(pts, m_out.m_audio.m_stream->time_base, av_get_time_base_q());
-            }
+            int64_t pos = output_pos();
 
             next_segment = static_cast<uint32_t>(pos / params.m_segment_duration + 1); // ????
 
@@ -4006,6 +4297,13 @@ int FFmpeg_Transcoder::process_single_fr(int &status)
             {
                 bool opened = false;
 
+                if (m_seek_to_fifo.empty() && !m_buffer->next_unfinished_segment(next_segment))
+                {
+                    // All remaining segments have been completed by an earlier run, nothing left to do.
+                    Logging::info(destname(), "Remaining HLS segments from no. %1 already complete.", next_segment);
+                    throw AVERROR_EOF;
+                }
+
                 encode_finish();
 
                 // Go to next requested segment
@@ -4016,60 +4314,64 @@ int FFmpeg_Transcoder::process_single_fr(int &status)
 
                     if (!m_buffer->segment_exists(segment_no) || !m_buffer->tell(segment_no)) // NOT EXISTS or NO DATA YET
                     {
-                        m_reset_pts    = true;      // Note that we have to reset audio/video pts to the new position
-                        m_have_seeked   = true;     // Note that we have seeked, thus skipped frames. We need to start transcoding over to fill any gaps.
-
-                        int64_t pos = (segment_no - 1) * params.m_segment_duration;
-
-                        if (m_in.m_video.m_stream_idx && m_out.m_video.m_stream_idx > -1)
+                        ret = do_seek_segment(segment_no);
+                        if (ret < 0)
                         {
-                            int64_t pts = av_rescale_q(pos, av_get_time_base_q(), m_in.m_video.m_stream->time_base);
+                            throw ret;
+                        }
 
-                            if (m_in.m_video.m_stream->start_time != AV_NOPTS_VALUE)
-                            {
-                                pts += m_in.m_video.m_stream->start_time;
-                            }
+                        next_segment = segment_no;
 
-                            ret = av_seek_frame(m_in.m_format_ctx, m_in.m_video.m_stream_idx, pts, AVSEEK_FLAG_BACKWARD);
-                        }
-                        else // if (m_out.m_audio.m_stream_idx > -1)
-                        {
-                            int64_t pts = av_rescale_q(pos, av_get_time_base_q(), m_in.m_audio.m_stream->time_base);
+                        opened = true;
 
-                            if (m_in.m_audio.m_stream->start_time != AV_NOPTS_VALUE)
-                            {
-                                pts += m_in.m_audio.m_stream->start_time;
-                            }
+                        break;
+                    }
+                }
 
-                            ret = av_seek_frame(m_in.m_format_ctx, m_in.m_audio.m_stream_idx, pts, AVSEEK_FLAG_BACKWARD);
-                        }
+                if (!opened && m_buffer->is_segment_finished(next_segment))
+                {
+                    // Already transcoded completely by an earlier run, skip to the next gap.
+                    uint32_t segment_no = m_buffer->next_unfinished_segment(next_segment);
 
-                        if (ret < 0)
+                    if (!segment_no)
+                    {
+                        // Nothing left behind this one, fill earlier gaps
+                        segment_no = m_buffer->next_unfinished_segment(1);
+                        if (!segment_no)
                         {
-                            Logging::error(destname(), "Seek failed on input file (error '%1').", ffmpeg_geterror(ret).c_str());
-                            throw ret;
+                            throw AVERROR_EOF;
                         }
+                    }
 
-                        if (m_in.m_audio.m_codec_ctx != nullptr)
-                        {
-                            avcodec_flush_buffers(m_in.m_audio.m_codec_ctx);
-                        }
+                    Logging::info(destname(), "HLS segment no. %1 already complete, skipping to segment no. %2.", next_segment, segment_no);
 
-                        if (m_in.m_video.m_codec_ctx != nullptr)
-                        {
-                            avcodec_flush_buffers(m_in.m_video.m_codec_ctx);
-                        }
+                    ret = do_seek_segment(segment_no);
+                    if (ret < 0)
+                    {
+                        throw ret;
+                    }
 
-                        close_output_file();
+                    next_segment = segment_no;
 
-                        open_output(m_buffer);
+                    opened = true;
+                }
 
-                        next_segment = segment_no;
+                if (!opened && adapt_encoder_speed(next_segment))
+                {
+                    // Encoder settings cannot be changed on the fly, restart at the segment boundary.
+                    // This is no real seek, so do not mark the result incomplete.
+                    bool have_seeked = m_have_seeked;
 
-                        opened = true;
+                    ret = do_seek_segment(next_segment);
 
-                        break;
+                    m_have_seeked = have_seeked;
+
+                    if (ret < 0)
+                    {
+                        throw ret;
                     }
+
+                    opened = true;
                 }
 
                 m_current_segment = next_segment;
@@ -4394,6 +4696,123 @@ int64_t FFmpeg_Transcoder::duration()
     }
 }
 
+int64_t FFmpeg_Transcoder::output_pos() const
+{
+    int64_t pos = 0;
+
+    if (m_out.m_video_pts && m_in.m_video.m_stream != nullptr && m_out.m_video.m_stream != nullptr)
+    {
+        int64_t pts = m_out.m_video_pts;
+
+        if (m_in.m_video.m_stream->start_time != AV_NOPTS_VALUE)
+        {
+            pts -= m_in.m_video.m_stream->start_time;
+        }
+
+        pos = av_rescale_q(pts, m_out.m_video.m_stream->time_base, av_get_time_base_q());
+    }
+    else if (m_out.m_audio_pts && m_in.m_audio.m_stream != nullptr && m_out.m_audio.m_stream != nullptr)
+    {
+        int64_t pts = m_out.m_audio_pts;
+
+        if (m_in.m_audio.m_stream->start_time != AV_NOPTS_VALUE)
+        {
+            pts -= m_in.m_audio.m_stream->start_time;
+        }
+        pos = av_rescale_q(pts, m_out.m_audio.m_stream->time_base, av_get_time_base_q());
+    }
+
+    return pos;
+}
+
+size_t FFmpeg_Transcoder::memory_usage() const
+{
+    size_t total = 0;
+
+    if (m_out.m_audio.m_codec_ctx != nullptr)
+    {
+        int sample_size = av_get_bytes_per_sample(m_out.m_audio.m_codec_ctx->sample_fmt) * m_out.m_audio.m_codec_ctx->channels;
+
+        if (m_audio_fifo != nullptr)
+        {
+            total += static_cast<size_t>(av_audio_fifo_size(m_audio_fifo) + av_audio_fifo_space(m_audio_fifo)) * static_cast<size_t>(sample_size);
+        }
+
+        total += static_cast<size_t>(m_converted_samples_max) * static_cast<size_t>(sample_size);
+    }
+
+    if (!m_video_fifo.empty())
+    {
+        const AVFrame *frame = m_video_fifo.front();
+        int size = av_image_get_buffer_size(static_cast<AVPixelFormat>(frame->format), frame->width, frame->height, 1);
+
+        if (size > 0)
+        {
+            total += m_video_fifo.size() * static_cast<size_t>(size);
+        }
+    }
+
+    // Memory inside codecs and filters cannot be queried, so a fixed amount is assumed for each open context
+    for (const AVCodecContext *codec_ctx : { m_in.m_audio.m_codec_ctx, m_out.m_audio.m_codec_ctx })
+    {
+        if (codec_ctx != nullptr)
+        {
+            total += MEMORY_CODEC_CTX;
+        }
+    }
+
+    for (const AVCodecContext *codec_ctx : { m_in.m_video.m_codec_ctx, m_out.m_video.m_codec_ctx })
+    {
+        if (codec_ctx != nullptr)
+        {
+            total += MEMORY_CODEC_CTX + MEMORY_CODEC_FRAMES * video_frame_size(codec_ctx);
+        }
+    }
+
+    if (m_filter_graph != nullptr)
+    {
+        total += MEMORY_CODEC_CTX + MEMORY_FILTER_FRAMES * video_frame_size(m_out.m_video.m_codec_ctx);
+    }
+
+    if (m_sws_ctx != nullptr)
+    {
+        total += MEMORY_CODEC_CTX;
+    }
+
+    // Probe and I/O buffers
+    for (const AVFormatContext *format_ctx : { m_in.m_format_ctx, m_out.m_format_ctx })
+    {
+        if (format_ctx != nullptr && format_ctx->pb != nullptr)
+        {
+            total += static_cast<size_t>(format_ctx->pb->buffer_size);
+        }
+    }
+
+    if (m_fileio != nullptr && params.m_readahead)
+    {
+        total += params.m_readahead * m_fileio->bufsize();
+    }
+
+    if (m_buffer != nullptr)
+    {
+        total += m_buffer->mapped_size();
+    }
+
+    return total;
+}
+
+size_t FFmpeg_Transcoder::video_frame_size(const AVCodecContext *codec_ctx)
+{
+    if (codec_ctx == nullptr)
+    {
+        return 0;
+    }
+
+    int size = av_image_get_buffer_size(codec_ctx->pix_fmt, codec_ctx->width, codec_ctx->height, 1);
+
+    return size > 0 ? static_cast<size_t>(size) : 0;
+}
+
 size_t FFmpeg_Transcoder::predicted_filesize()
 {
     if (m_virtualfile != nullptr)
@@ -4446,7 +4865,13 @@ int FFmpeg_Transcoder::encode_finish()
         m_buffer->finished_segment();
 
         // Get segment VIRTUALFILE object
-        std::string filename(m_buffer->virtualfile()->m_origfile + "/" + make_filename(m_current_segment, params.current_format(m_buffer->virtualfile())->fileext()));
+        std::string dirname(m_buffer->virtualfile()->m_origfile);
+        if (m_buffer->virtualfile()->m_type == VIRTUALTYPE_REMOTE)
+        {
+            // The set is named after the remote file, without the extension of the link
+            remove_ext(&dirname);
+        }
+        std::string filename(dirname + "/" + make_filename(m_current_segment, params.current_format(m_buffer->virtualfile())->fileext()));
         LPVIRTUALFILE virtualfile = find_file(filename.c_str());
 
         if (virtualfile != nullptr)
@@ -4493,6 +4918,12 @@ int FFmpeg_Transcoder::input_read(void * opaque, unsigned char * data, int size)
         return AVERROR(io->error());
     }
 
+    if (!read)
+    {
+        // AVIO does not accept 0 as return value
+        return AVERROR_EOF;
+    }
+
     return read;
 }
 
@@ -4633,6 +5064,20 @@ bool FFmpeg_Transcoder::close_output_file()
         closed = true;
     }
 
+    if (m_picture_pool != nullptr)
+    {
+        av_buffer_pool_uninit(&m_picture_pool);
+        m_picture_pool_size = 0;
+    }
+
+    free_converted_samples();
+
+    if (m_audio_frame_pool != nullptr)
+    {
+        av_buffer_pool_uninit(&m_audio_frame_pool);
+        m_audio_frame_pool_size = 0;
+    }
+
     // Close output file
 #if !LAVF_DEP_AVSTREAM_CODEC
     if (m_out.m_audio.m_codec_ctx)
@@ -51,6 +51,8 @@ struct SwrContext;
 struct AVAudioResampleContext;
 #endif
 struct SwsContext;
+struct AVBufferPool;
+struct AVBufferRef;
 struct AVFilterContext;
 struct AVFilterGraph;
 struct AVAudioFifo;
@@ -204,6 +206,21 @@ public:
      * @return Returns the file in AV_TIME_BASE units.
      */
     int64_t                     duration();
+    /**
+     * @brief Get the position the output has currently reached.
+     * @return Returns the output position in AV_TIME_BASE fractional seconds.
+     */
+    int64_t                     output_pos() const;
+    /**
+     * @brief Estimate the memory held by this transcoder.
+     *
+     * Counts the sample and frame buffers, the I/O and read ahead buffers and the mapped
+     * cache files. Memory allocated inside codecs and filters cannot be queried, a fixed
+     * amount plus some frames is assumed for each open context instead.
+     *
+     * @return Returns the estimated memory usage in bytes.
+     */
+    size_t                      memory_usage() const;
     /**
      * @brief Try to predict the recoded file size. This may (better will surely) be inaccurate.
      * @return Predicted file size in bytes.
@@ -457,11 +474,17 @@ protected:
      * @brief Initialise a temporary storage for the specified number of audio samples.
      * The conversion requires temporary storage due to the different format.
      * The number of audio samples to be allocated is specified in frame_size.
+     * The storage is kept and reused for subsequent frames, it is only reallocated
+     * if frame_size exceeds its current capacity. It must not be freed by the caller.
      * @param[out] converted_input_samples - Memory for input samples.
      * @param[in] frame_size - Size of one frame.
      * @return On success returns 0; on error negative AVERROR.
      */
     int                         init_converted_samples(uint8_t ***converted_input_samples, int frame_size);
+    /**
+     * @brief Free the storage allocated by init_converted_samples().
+     */
+    void                        free_converted_samples();
     /**
      * @brief Convert the input audio samples into the output sample format.
      * The conversion happens on a per-frame basis, the size of which is
@@ -508,12 +531,22 @@ protected:
     int                         init_audio_output_frame(AVFrame **frame, int frame_size);
     /**
      * @brief Allocate memory for one picture.
+     * Picture buffers are taken from a pool and go back there once the frame is freed, so
+     * the memory is recycled instead of allocated for every frame. Lines are aligned for SIMD.
      * @param[in] pix_fmt - Pixel format
      * @param[in] width - Picture width
      * @param[in] height - Picture height
      * @return On success returns new AVFrame or nullptr on error
      */
     AVFrame *                   alloc_picture(AVPixelFormat pix_fmt, int width, int height);
+    /**
+     * @brief Get a buffer from a pool, (re)creating the pool if its buffers are too small.
+     * @param[inout] pool - Buffer pool, may point to nullptr if not yet created.
+     * @param[inout] pool_size - Size of the buffers in pool.
+     * @param[in] size - Minimum buffer size required.
+     * @return On success returns new buffer reference or nullptr if out of memory.
+     */
+    AVBufferRef *               get_pool_buffer(AVBufferPool **pool, int *pool_size, int size);
     /**
      * @brief Produce audio dts/pts. This is required because the target codec usually has a different
      * frame size than the source, so the number of packets will not match 1:1.
@@ -603,6 +636,12 @@ protected:
      * @return Bitrate in bit/s.
      */
     static BITRATE              get_prores_bitrate(int width, int height, const AVRational &framerate, int interleaved, int profile);
+    /**
+     * @brief Get the size of one picture of a video codec context.
+     * @param[in] codec_ctx - Video codec context, may be nullptr.
+     * @return Returns the picture size in bytes, 0 if unknown.
+     */
+    static size_t               video_frame_size(const AVCodecContext *codec_ctx);
     /**
      * @brief Try to predict final file size.
      */
@@ -701,6 +740,27 @@ protected:
      * @return Returns 0 if OK, or negative AVERROR value.
      */
     int                         skip_decoded_frames(uint32_t frame_no, bool forced_seek);
+    /**
+     * @brief Actually perform seek to HLS segment.
+     * Positions the input at the segment start and reopens the output. The caller must make segment_no the current segment.
+     * @param[in] segment_no - Segment number 1...n to seek to.
+     * @return Returns 0 if OK, or negative AVERROR value.
+     */
+    int                         do_seek_segment(uint32_t segment_no);
+    /**
+     * @brief Decide which encoder settings to use from the next HLS segment on.
+     * Compares the segment about to be started with the segment the client currently reads.
+     * @param[in] segment_no - Segment number 1...n that will be started next.
+     * @return Returns true if the encoder settings must be changed, false if not.
+     */
+    bool                        adapt_encoder_speed(uint32_t segment_no);
+    /**
+     * @brief Override an encoder speed option if running in quality mode.
+     * @param[in] codec_ctx - Output codec context to set the option for.
+     * @param[in] key - Option name, e.g. "preset".
+     * @param[in] value - Option value that trades speed for quality.
+     */
+    void                        set_quality_option(AVCodecContext *codec_ctx, const char *key, const char *value) const;
 
 private:
     FileIO *                    m_fileio;                   /**< @brief FileIO object of input file */
@@ -723,9 +783,15 @@ private:
     AVAudioResampleContext *    m_audio_resample_ctx;       /**< @brief AVResample context for audio resampling */
 #endif
     AVAudioFifo *               m_audio_fifo;               /**< @brief Audio sample FIFO */
+    uint8_t **                  m_converted_samples;        /**< @brief Reusable storage for converted input samples */
+    int                         m_converted_samples_max;    /**< @brief Capacity of m_converted_samples in samples per channel */
+    AVBufferPool *              m_audio_frame_pool;         /**< @brief Pool of sample buffers for audio output frames */
+    int                         m_audio_frame_pool_size;    /**< @brief Size of one buffer in m_audio_frame_pool */
 
     // Video conversion and buffering
     SwsContext *                m_sws_ctx;                  /**< @brief Context for video filtering */
+    AVBufferPool *              m_picture_pool;             /**< @brief Pool of picture buffers for scaled frames */
+    int                         m_picture_pool_size;        /**< @brief Size of one buffer in m_picture_pool */
     AVFilterContext *           m_buffer_sink_context;      /**< @brief Video filter sink context */
     AVFilterContext *           m_buffer_source_context;    /**< @brief Video filter source context */
     AVFilterGraph *             m_filter_graph;             /**< @brief Video filter graph */
@@ -748,6 +814,7 @@ private:
 
     bool                        m_reset_pts;                /**< @brief We have to reset audio/video pts to the new position */
     uint32_t                    m_fake_frame_no;            /**< @brief The MJEPG codec requires monotonically growing PTS values so we fake some to avoid them going backwards after seeks */
+    bool                        m_quality_mode;             /**< @brief Far enough ahead of the reader, use slower encoder settings for better quality */
 
     static const PRORES_BITRATE m_prores_bitrate[];         /**< @brief ProRes bitrate table. Used for file size prediction. */
 };
@@ -1321,6 +1321,50 @@ bool file_exists(const std::string & filename)
     return (access(filename.c_str(), F_OK) != -1);
 }
 
+size_t get_anonymous_size()
+{
+    FILE *fp = fopen("/proc/self/smaps_rollup", "r");
+
+    if (fp != nullptr)
+    {
+        char line[256];
+        unsigned long anonymous_kb = 0;
+        bool found = false;
+
+        while (!found && fgets(line, sizeof(line), fp) != nullptr)
+        {
+            found = (sscanf(line, "Anonymous: %lu kB", &anonymous_kb) == 1);
+        }
+
+        fclose(fp);
+
+        if (found)
+        {
+            return static_cast<size_t>(anonymous_kb) * 1024;
+        }
+    }
+
+    // Before Linux 4.14: resident pages that are not file backed
+    fp = fopen("/proc/self/statm", "r");
+    unsigned long pages_total = 0;
+    unsigned long pages_resident = 0;
+    unsigned long pages_shared = 0;
+
+    if (fp == nullptr)
+    {
+        return 0;
+    }
+
+    if (fscanf(fp, "%lu %lu %lu", &pages_total, &pages_resident, &pages_shared) != 3 || pages_shared > pages_resident)
+    {
+        pages_resident = pages_shared = 0;
+    }
+
+    fclose(fp);
+
+    return static_cast<size_t>(pages_resident - pages_shared) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
 void make_upper(std::string * input)
 {
     std::for_each(std::begin(*input), std::end(*input), [](char& c) {
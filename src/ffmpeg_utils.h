@@ -704,4 +704,14 @@ std::string         make_filename(uint32_t file_no, const std::string &fileext);
  */
 bool                file_exists(const std::string & filename);
 
+/**
+ * @brief Get the anonymous memory of this process that is resident.
+ *
+ * Unlike the resident set size, this does not include file backed pages, e.g. of mapped cache files,
+ * which the kernel can drop at any time.
+ *
+ * @return Returns the resident anonymous memory in bytes, or 0 if it cannot be determined.
+ */
+size_t              get_anonymous_size();
+
 #endif
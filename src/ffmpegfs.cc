@@ -110,6 +110,7 @@ FFMPEGFS_PARAMS::FFMPEGFS_PARAMS()
     , m_expiry_time((60*60*24 /* d */) * 7)     // default: 1 week)
     , m_max_inactive_suspend(15)                // default: 15 seconds
     , m_max_inactive_abort(30)                  // default: 30 seconds
+    , m_drain_timeout(15)                       // default: 15 seconds
     , m_prebuffer_size(100 /* KB */ * 1024)     // default: 100 KB
     , m_max_cache_size(0)                       // default: no limit
     , m_min_diskspace(0)                        // default: no minimum
@@ -119,6 +120,18 @@ FFMPEGFS_PARAMS::FFMPEGFS_PARAMS()
     , m_prune_cache(0)                          // default: Do not prune cache immediately
     , m_clear_cache(0)                          // default: Do not clear cache on startup
     , m_max_threads(0)                          // default: 16 * CPU cores (this value here is overwritten later)
+    , m_max_transcoders(0)                      // default: CPU cores (this value here is overwritten later)
+    , m_min_encode_speed(0)                     // default: no admission control
+    , m_adapt_speed(0)                          // default: fixed encoder settings
+    , m_numa(0)                                 // default: let the kernel place threads
+    , m_shared_sessions(0)                      // default: do not share
+    , m_watch_sources(0)                        // default: check on open
+    , m_readdir_cache(0)                        // default: no directory listing cache
+    , m_max_memory(0)                           // default: no limit
+    , m_io_block_size(100 /* KB */ * 1024)      // default: 100 KB
+    , m_readahead(0)                            // default: read synchronously
+    , m_remote_connections(4)                   // default: 4 connections
+    , m_remote_cache(64 /* MB */ * 1024 * 1024) // default: 64 MB
     , m_decoding_errors(0)                      // default: ignore errors
     , m_min_dvd_chapter_duration(1)             // default: 1 second
     , m_oldnamescheme(0)                        // default: new scheme
@@ -210,9 +223,13 @@ enum
     KEY_EXPIRY_TIME,
     KEY_MAX_INACTIVE_SUSPEND_TIME,
     KEY_MAX_INACTIVE_ABORT_TIME,
+    KEY_DRAIN_TIMEOUT,
     KEY_PREBUFFER_SIZE,
     KEY_MAX_CACHE_SIZE,
     KEY_MIN_DISKSPACE_SIZE,
+    KEY_MAX_MEMORY,
+    KEY_IO_BLOCK_SIZE,
+    KEY_REMOTE_CACHE,
     KEY_CACHEPATH,
     KEY_CACHE_MAINTENANCE,
     KEY_AUTOCOPY,
@@ -283,6 +300,8 @@ static struct fuse_opt ffmpegfs_opts[] =
     FUSE_OPT_KEY("max_inactive_suspend=%s",         KEY_MAX_INACTIVE_SUSPEND_TIME),
     FUSE_OPT_KEY("--max_inactive_abort=%s",         KEY_MAX_INACTIVE_ABORT_TIME),
     FUSE_OPT_KEY("max_inactive_abort=%s",           KEY_MAX_INACTIVE_ABORT_TIME),
+    FUSE_OPT_KEY("--drain_timeout=%s",              KEY_DRAIN_TIMEOUT),
+    FUSE_OPT_KEY("drain_timeout=%s",                KEY_DRAIN_TIMEOUT),
     FUSE_OPT_KEY("--prebuffer_size=%s",             KEY_PREBUFFER_SIZE),
     FUSE_OPT_KEY("prebuffer_size=%s",               KEY_PREBUFFER_SIZE),
     FUSE_OPT_KEY("--max_cache_size=%s",             KEY_MAX_CACHE_SIZE),
@@ -302,6 +321,30 @@ static struct fuse_opt ffmpegfs_opts[] =
     // Other
     FFMPEGFS_OPT("--max_threads=%u",                m_max_threads, 0),
     FFMPEGFS_OPT("max_threads=%u",                  m_max_threads, 0),
+    FFMPEGFS_OPT("--max_transcoders=%u",            m_max_transcoders, 0),
+    FFMPEGFS_OPT("max_transcoders=%u",              m_max_transcoders, 0),
+    FFMPEGFS_OPT("--min_encode_speed=%u",           m_min_encode_speed, 0),
+    FFMPEGFS_OPT("min_encode_speed=%u",             m_min_encode_speed, 0),
+    FFMPEGFS_OPT("--adapt_speed",                   m_adapt_speed, 1),
+    FFMPEGFS_OPT("adapt_speed",                     m_adapt_speed, 1),
+    FFMPEGFS_OPT("--numa",                          m_numa, 1),
+    FFMPEGFS_OPT("numa",                            m_numa, 1),
+    FFMPEGFS_OPT("--shared_sessions",               m_shared_sessions, 1),
+    FFMPEGFS_OPT("shared_sessions",                 m_shared_sessions, 1),
+    FFMPEGFS_OPT("--watch_sources",                 m_watch_sources, 1),
+    FFMPEGFS_OPT("watch_sources",                   m_watch_sources, 1),
+    FFMPEGFS_OPT("--readdir_cache=%u",              m_readdir_cache, 0),
+    FFMPEGFS_OPT("readdir_cache=%u",                m_readdir_cache, 0),
+    FUSE_OPT_KEY("--max_memory=%s",                 KEY_MAX_MEMORY),
+    FUSE_OPT_KEY("max_memory=%s",                   KEY_MAX_MEMORY),
+    FUSE_OPT_KEY("--io_block_size=%s",              KEY_IO_BLOCK_SIZE),
+    FUSE_OPT_KEY("io_block_size=%s",                KEY_IO_BLOCK_SIZE),
+    FFMPEGFS_OPT("--readahead=%u",                  m_readahead, 0),
+    FFMPEGFS_OPT("readahead=%u",                    m_readahead, 0),
+    FFMPEGFS_OPT("--remote_connections=%u",         m_remote_connections, 0),
+    FFMPEGFS_OPT("remote_connections=%u",           m_remote_connections, 0),
+    FUSE_OPT_KEY("--remote_cache=%s",               KEY_REMOTE_CACHE),
+    FUSE_OPT_KEY("remote_cache=%s",                 KEY_REMOTE_CACHE),
     FFMPEGFS_OPT("--decoding_errors=%u",            m_decoding_errors, 0),
     FFMPEGFS_OPT("decoding_errors=%u",              m_decoding_errors, 0),
     FFMPEGFS_OPT("--min_dvd_chapter_duration=%u",   m_min_dvd_chapter_duration, 0),
@@ -1265,6 +1308,10 @@ static int ffmpegfs_opt_proc(void* data, const char* arg, int key, struct fuse_a
     {
         return get_time(arg, &params.m_max_inactive_abort);
     }
+    case KEY_DRAIN_TIMEOUT:
+    {
+        return get_time(arg, &params.m_drain_timeout);
+    }
     case KEY_PREBUFFER_SIZE:
     {
         return get_size(arg, &params.m_prebuffer_size);
@@ -1277,6 +1324,30 @@ static int ffmpegfs_opt_proc(void* data, const char* arg, int key, struct fuse_a
     {
         return get_size(arg, &params.m_min_diskspace);
     }
+    case KEY_MAX_MEMORY:
+    {
+        return get_size(arg, &params.m_max_memory);
+    }
+    case KEY_IO_BLOCK_SIZE:
+    {
+        if (get_size(arg, &params.m_io_block_size) < 0)
+        {
+            return -1;
+        }
+
+        // Passed to FFmpeg as int
+        if (params.m_io_block_size < 4 /* KB */ * 1024 || params.m_io_block_size > 64 /* MB */ * 1024 * 1024)
+        {
+            std::fprintf(stderr, "INVALID PARAMETER: io_block_size %s is out of range. It must be between 4 KB and 64 MB.\n", format_size(params.m_io_block_size).c_str());
+            return -1;
+        }
+
+        return 0;
+    }
+    case KEY_REMOTE_CACHE:
+    {
+        return get_size(arg, &params.m_remote_cache);
+    }
     case KEY_CACHEPATH:
     {
         return get_value(arg, &params.m_cachepath);
@@ -1370,6 +1441,7 @@ static void print_params(void)
     Logging::trace(nullptr, "Expiry Time       : %1", format_time(params.m_expiry_time).c_str());
     Logging::trace(nullptr, "Inactivity Suspend: %1", format_time(params.m_max_inactive_suspend).c_str());
     Logging::trace(nullptr, "Inactivity Abort  : %1", format_time(params.m_max_inactive_abort).c_str());
+    Logging::trace(nullptr, "Drain Timeout     : %1", format_time(params.m_drain_timeout).c_str());
     Logging::trace(nullptr, "Pre-buffer size   : %1", format_size(params.m_prebuffer_size).c_str());
     Logging::trace(nullptr, "Max. Cache Size   : %1", format_size(params.m_max_cache_size).c_str());
     Logging::trace(nullptr, "Min. Disk Space   : %1", format_size(params.m_min_diskspace).c_str());
@@ -1380,6 +1452,18 @@ static void print_params(void)
     Logging::trace(nullptr, "--------- Various Options ---------");
     Logging::trace(nullptr, "Remove Album Arts : %1", params.m_noalbumarts ? "yes" : "no");
     Logging::trace(nullptr, "Max. Threads      : %1", format_number(params.m_max_threads).c_str());
+    Logging::trace(nullptr, "Max. Transcoders  : %1", params.m_max_transcoders ? format_number(params.m_max_transcoders).c_str() : "unlimited");
+    Logging::trace(nullptr, "Min. Encode Speed : %1", params.m_min_encode_speed ? (format_number(params.m_min_encode_speed) + "%").c_str() : "unlimited");
+    Logging::trace(nullptr, "Adapt Speed       : %1", params.m_adapt_speed ? "yes" : "no");
+    Logging::trace(nullptr, "NUMA Placement    : %1", params.m_numa ? "yes" : "no");
+    Logging::trace(nullptr, "Shared Sessions   : %1", params.m_shared_sessions ? "yes" : "no");
+    Logging::trace(nullptr, "Watch Sources     : %1", params.m_watch_sources ? "yes" : "no");
+    Logging::trace(nullptr, "Readdir Cache     : %1", params.m_readdir_cache ? (format_number(params.m_readdir_cache) + " directories").c_str() : "disabled");
+    Logging::trace(nullptr, "Max. Memory       : %1", params.m_max_memory ? format_size(params.m_max_memory).c_str() : "unlimited");
+    Logging::trace(nullptr, "I/O Block Size    : %1", format_size(params.m_io_block_size).c_str());
+    Logging::trace(nullptr, "Read Ahead        : %1", params.m_readahead ? (format_number(params.m_readahead) + " blocks").c_str() : "disabled");
+    Logging::trace(nullptr, "Remote Connections: %1", params.m_remote_connections);
+    Logging::trace(nullptr, "Remote Cache      : %1", format_size(params.m_remote_cache).c_str());
     Logging::trace(nullptr, "Decoding Errors   : %1", params.m_decoding_errors ? "break transcode" : "ignore");
     Logging::trace(nullptr, "Min. DVD Chapter  : %1", format_duration(params.m_min_dvd_chapter_duration * AV_TIME_BASE).c_str());
     Logging::trace(nullptr, "Old Name Scheme   : %1", params.m_oldnamescheme ? "yes" : "no");
@@ -1427,6 +1511,7 @@ int main(int argc, char *argv[])
 
     // Set default
     params.m_max_threads = static_cast<unsigned int>(get_nprocs() * 16);
+    params.m_max_transcoders = static_cast<unsigned int>(get_nprocs());
 
     if (fuse_opt_parse(&args, &params, ffmpegfs_opts, ffmpegfs_opt_proc))
     {
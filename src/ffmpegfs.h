@@ -161,6 +161,7 @@ extern struct FFMPEGFS_PARAMS
     time_t              m_expiry_time;              /**< @brief Time (seconds) after which an cache entry is deleted */
     time_t              m_max_inactive_suspend;     /**< @brief Time (seconds) that must elapse without access until transcoding is suspended */
     time_t              m_max_inactive_abort;       /**< @brief Time (seconds) that must elapse without access until transcoding is aborted */
+    time_t              m_drain_timeout;            /**< @brief Time (seconds) to wait for transcoders to stop on shutdown */
     size_t              m_prebuffer_size;           /**< @brief Number of bytes that will be decoded before it can be accessed */
     size_t              m_max_cache_size;           /**< @brief Max. cache size in MB. When exceeded, oldest entries will be pruned */
     size_t              m_min_diskspace;            /**< @brief Min. diskspace required for cache */
@@ -170,6 +171,18 @@ extern struct FFMPEGFS_PARAMS
     int                 m_prune_cache;              /**< @brief Prune cache immediately */
     int                 m_clear_cache;              /**< @brief Clear cache on start up */
     unsigned int        m_max_threads;              /**< @brief Max. number of recoder threads */
+    unsigned int        m_max_transcoders;          /**< @brief Max. number of transcoders busy at the same time, 0 for no limit */
+    unsigned int        m_min_encode_speed;         /**< @brief Start new transcodes only while running ones reach this speed, in percent of real time. 0 to disable. */
+    int                 m_adapt_speed;              /**< @brief HLS only: Use slower encoder settings while far enough ahead of the reader */
+    int                 m_numa;                     /**< @brief Bind each transcoder to one NUMA node */
+    int                 m_shared_sessions;          /**< @brief Share running transcodes with other FFmpegfs processes using the same cache */
+    int                 m_watch_sources;            /**< @brief Watch input directories for changes instead of checking source files on every open */
+    unsigned int        m_readdir_cache;            /**< @brief Max. number of directory listings kept in memory, 0 to disable */
+    size_t              m_max_memory;               /**< @brief Memory ceiling in bytes. When exceeded, the largest transcoders give way. 0 for unlimited. */
+    size_t              m_io_block_size;            /**< @brief Block size for reading input files from disk */
+    unsigned int        m_readahead;                /**< @brief Number of input blocks to read ahead in a separate thread, 0 to read synchronously */
+    unsigned int        m_remote_connections;       /**< @brief Number of parallel connections per remote file */
+    size_t              m_remote_cache;             /**< @brief Size of the block cache per remote file */
     // Miscellanous options
     int                 m_decoding_errors;          /**< @brief Break transcoding on decoding error */
     int                 m_min_dvd_chapter_duration; /**< @brief Min. DVD chapter duration. Shorter chapters will be ignored. */
@@ -283,6 +296,32 @@ bool            check_path(const std::string & path);
  * @return Returns number of files found.
  */
 int             load_path(const std::string & path, const struct stat *statbuf, void *buf, fuse_fill_dir_t filler);
+/**
+ * @brief Load the virtual files of a DVD, Blu-ray or Video CD from an earlier scan, saving the time to parse the disc again.
+ * @param[in] type - Type of disc.
+ * @param[in] path - Physical path of disc.
+ * @param[in] stamp - Stamp of the disc structure, see disc_stamp().
+ * @param[in] statbuf - stat buffer to load.
+ * @param[in] buf - FUSE buffer to fill.
+ * @param[in] filler - Filler function.
+ * @return Returns number of files found, 0 if the disc has not been scanned or was changed since.
+ */
+int             load_disc(VIRTUALTYPE type, const std::string & path, uint64_t stamp, const struct stat *statbuf, void *buf, fuse_fill_dir_t filler);
+/**
+ * @brief Save the virtual files of a freshly parsed DVD, Blu-ray or Video CD.
+ * @param[in] type - Type of disc.
+ * @param[in] path - Physical path of disc.
+ * @param[in] stamp - Stamp of the disc structure, see disc_stamp().
+ */
+void            save_disc(VIRTUALTYPE type, const std::string & path, uint64_t stamp);
+/**
+ * @brief Get a stamp of a DVD, Blu-ray or Video CD structure.
+ * Built from names, sizes and modification times of the files in the disc directories,
+ * and the options that change the parse result.
+ * @param[in] path - Physical path of disc.
+ * @return Returns the stamp. If it changes the disc must be parsed again.
+ */
+uint64_t        disc_stamp(const std::string & path);
 /**
  * @brief Given the destination (post-transcode) file name, determine the parent of the file to be transcoded.
  * @param[in] origpath - The original file
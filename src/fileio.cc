@@ -33,6 +33,7 @@
 #include "ffmpegfs.h"
 #include "buffer.h"
 #include "diskio.h"
+#include "remoteio.h"
 #ifdef USE_LIBVCD
 #include "vcdio.h"
 #endif // USE_LIBVCD
@@ -94,6 +95,10 @@ FileIO * FileIO::alloc(VIRTUALTYPE type)
         return new(std::nothrow) BlurayIO;
     }
 #endif // USE_LIBBLURAY
+    case VIRTUALTYPE_REMOTE:
+    {
+        return new(std::nothrow) RemoteIO;
+    }
     default:
     {
         return new(std::nothrow) DiskIO;    // TEST
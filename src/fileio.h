@@ -99,6 +99,7 @@ typedef enum VIRTUALTYPE
 #ifdef USE_LIBBLURAY
     VIRTUALTYPE_BLURAY,                                             /**< @brief Bluray disk file */
 #endif // USE_LIBBLURAY
+    VIRTUALTYPE_REMOTE,                                             /**< @brief Remote file, read from a URL in a link file */
 
     VIRTUALTYPE_BUFFER,                                             /**< @brief Buffer file */
 } VIRTUALTYPE;
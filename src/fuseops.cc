@@ -36,33 +36,73 @@
 #include "transcode.h"
 #include "ffmpeg_utils.h"
 #include "cache_maintenance.h"
+#include "shared_session.h"
+#include "watcher.h"
 #include "logging.h"
 #ifdef USE_LIBVCD
 #include "vcdparser.h"
 #endif // USE_LIBVCD
 #ifdef USE_LIBDVD
 #include "dvdparser.h"
+#include "dvdio.h"
 #endif // USE_LIBDVD
 #ifdef USE_LIBBLURAY
 #include "blurayparser.h"
+#include "blurayio.h"
 #endif // USE_LIBBLURAY
 #include "thread_pool.h"
 #include "buffer.h"
 #include "cache_entry.h"
+#include "remoteio.h"
 
 #include <dirent.h>
 #include <unistd.h>
 #include <map>
 #include <regex>
 #include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
 #include <assert.h>
 #include <signal.h>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 
 /**
  * @brief Map source file names to virtual file objects.
  */
 typedef std::map<std::string, VIRTUALFILE> filenamemap;
 
+/**
+ * @brief Entry of a cached directory listing
+ */
+typedef struct DIRENTRY
+{
+    std::string         m_origname;             /**< @brief Name of source file */
+    std::string         m_name;                 /**< @brief Name shown by FUSE, transcoded name for media files */
+    struct stat         m_st;                   /**< @brief stat of source file, as shown by FUSE */
+} DIRENTRY;
+
+/**
+ * @brief Cached directory listing
+ *
+ * Once in the cache, entries and directory times are not changed. An updated listing replaces the old one,
+ * which readers still using it keep alive. m_checked and m_last_used may only be accessed with dirlistings_mutex held.
+ */
+typedef struct DIRLISTING
+{
+    std::vector<DIRENTRY> m_entries;            /**< @brief Entries, in directory order */
+    struct timespec     m_mtime;                /**< @brief Modification time of directory when listed */
+    struct timespec     m_ctime;                /**< @brief Status change time of directory when listed */
+    ino_t               m_ino;                  /**< @brief Inode of directory, changes if replaced */
+    time_t              m_listed;               /**< @brief Time the directory was read */
+    uint64_t            m_checked;              /**< @brief Source watcher sequence number when the entries were checked, 0 if not watched */
+    time_t              m_last_used;            /**< @brief Time the listing was used last, for cache eviction */
+} DIRLISTING;
+
+typedef std::unordered_map<std::string, std::shared_ptr<DIRLISTING>> dirlistingmap;
+
 static void             init_stat(struct stat *stbuf, size_t fsize, time_t ftime, bool directory);
 static LPVIRTUALFILE    make_file(void *buf, fuse_fill_dir_t filler, VIRTUALTYPE type, const std::string & origpath, const std::string & filename, size_t fsize, time_t ftime = time(nullptr), int flags = VIRTUALFLAG_NONE);
 static void             prepare_script();
@@ -70,6 +110,9 @@ static void             translate_path(std::string *origpath, const char* path);
 static bool             transcoded_name(std::string *filepath, FFmpegfs_Format **current_format = nullptr);
 static filenamemap::const_iterator find_prefix(const filenamemap & map, const std::string & search_for);
 static int              get_source_properties(const std::string & origpath, LPVIRTUALFILE virtualfile);
+static bool             make_dirent(const std::string & origpath, const std::string & origname, DIRENTRY * entry);
+static bool             dirlisting_valid(const DIRLISTING & listing, const struct stat & dirstat);
+static int              list_directory(const std::string & origpath, void *buf, fuse_fill_dir_t filler);
 static int              make_hls_fileset(void * buf, fuse_fill_dir_t filler, const std::string & origpath, LPVIRTUALFILE virtualfile);
 
 static int              ffmpegfs_readlink(const char *path, char *buf, size_t size);
@@ -84,8 +127,22 @@ static void             sighandler(int signum);
 static void *           ffmpegfs_init(struct fuse_conn_info *conn);
 static void             ffmpegfs_destroy(__attribute__((unused)) void * p);
 static std::string      get_number(const char *path, uint32_t *value);
+#if defined(USE_LIBDVD) || defined(USE_LIBBLURAY)
+static void             disc_cleanup_loop();
+static void             start_disc_cleanup();
+static void             stop_disc_cleanup();
+
+#define DISC_CLEANUP_INTERVAL   15      /**< @brief Seconds between checks for unused disc handles */
+
+static std::thread              disc_cleanup_thread;    /**< @brief Closes disc handles no longer used */
+static std::mutex               disc_cleanup_mutex;     /**< @brief Access mutex for disc_cleanup_stop */
+static std::condition_variable  disc_cleanup_cond;      /**< @brief Wakes up disc_cleanup_thread on shutdown */
+static bool                     disc_cleanup_stop;      /**< @brief If true, disc_cleanup_thread exits */
+#endif // USE_LIBDVD || USE_LIBBLURAY
 
 static filenamemap          filenames;          /**< @brief Map files to virtual files */
+static dirlistingmap        dirlistings;        /**< @brief Cached directory listings by physical path */
+static std::mutex           dirlistings_mutex;  /**< @brief Access mutex for dirlistings */
 static std::vector<char>    script_file;        /**< @brief Buffer for the virtual script if enabled */
 
 static struct sigaction     oldHandler;         /**< @brief Saves old SIGINT handler to restore on shutdown */
@@ -532,6 +589,128 @@ int load_path(const std::string & path, const struct stat *statbuf, void *buf, f
     return title_count;
 }
 
+int load_disc(VIRTUALTYPE type, const std::string & path, uint64_t stamp, const struct stat *statbuf, void *buf, fuse_fill_dir_t filler)
+{
+    std::vector<VIRTUALFILE> virtualfiles;
+
+    if (!transcoder_read_disc(path, stamp, &virtualfiles))
+    {
+        return 0;
+    }
+
+    for (const VIRTUALFILE & cached : virtualfiles)
+    {
+        struct stat stbuf;
+
+        memcpy(&stbuf, statbuf, sizeof(struct stat));
+
+        stbuf.st_mode   = cached.m_st.st_mode;
+        stbuf.st_nlink  = cached.m_st.st_nlink;
+        stbuf.st_size   = cached.m_st.st_size;
+        stbuf.st_blocks = (stbuf.st_size + 512 - 1) / 512;
+
+        LPVIRTUALFILE virtualfile = insert_file(type, cached.m_origfile, &stbuf, cached.m_flags);
+
+        // Discs are video format anyway
+        virtualfile->m_format_idx           = 0;
+        virtualfile->m_full_title           = cached.m_full_title;
+        virtualfile->m_duration             = cached.m_duration;
+        virtualfile->m_predicted_size       = cached.m_predicted_size;
+        virtualfile->m_video_frame_count    = cached.m_video_frame_count;
+#ifdef USE_LIBVCD
+        virtualfile->m_vcd                  = cached.m_vcd;
+#endif // USE_LIBVCD
+#ifdef USE_LIBDVD
+        virtualfile->m_dvd                  = cached.m_dvd;
+#endif // USE_LIBDVD
+#ifdef USE_LIBBLURAY
+        virtualfile->m_bluray               = cached.m_bluray;
+#endif // USE_LIBBLURAY
+    }
+
+    Logging::trace(path, "Loaded %1 titles from earlier scan.", virtualfiles.size());
+
+    return load_path(path, statbuf, buf, filler);
+}
+
+void save_disc(VIRTUALTYPE type, const std::string & path, uint64_t stamp)
+{
+    std::vector<LPCVIRTUALFILE> virtualfiles;
+
+    for (filenamemap::const_iterator it = filenames.lower_bound(path); it != filenames.end(); it++)
+    {
+        std::string key = it->first;
+
+        if (key.compare(0, path.size(), path) != 0)
+        {
+            break;
+        }
+
+        remove_filename(&key);
+        if (key == path && it->second.m_type == type)
+        {
+            virtualfiles.push_back(&it->second);
+        }
+    }
+
+    if (!virtualfiles.empty() && !transcoder_write_disc(path, stamp, virtualfiles))
+    {
+        Logging::warning(path, "Unable to save titles, the disc will be parsed again on next start.");
+    }
+}
+
+uint64_t disc_stamp(const std::string & path)
+{
+    static const char * subdirs[] = { "", "VIDEO_TS/", "BDMV/", "BDMV/PLAYLIST/", "VCD/", "SVCD/", nullptr };
+    uint64_t stamp = 14695981039346656037ULL;     // FNV-1a 64 bit offset basis
+
+    auto mix = [&stamp](const void *data, size_t size)
+    {
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        for (size_t n = 0; n < size; n++)
+        {
+            stamp ^= p[n];
+            stamp *= 1099511628211ULL;              // FNV-1a 64 bit prime
+        }
+    };
+
+    // Options that change the titles found or their size
+    mix(&params.m_min_dvd_chapter_duration, sizeof(params.m_min_dvd_chapter_duration));
+    mix(&params.m_audiobitrate, sizeof(params.m_audiobitrate));
+    mix(&params.m_audiosamplerate, sizeof(params.m_audiosamplerate));
+    mix(&params.m_videobitrate, sizeof(params.m_videobitrate));
+    mix(&params.m_videowidth, sizeof(params.m_videowidth));
+    mix(&params.m_videoheight, sizeof(params.m_videoheight));
+
+    for (const char ** subdir = subdirs; *subdir != nullptr; subdir++)
+    {
+        std::string dirpath(path + *subdir);
+        struct dirent **namelist;
+        int count = scandir(dirpath.c_str(), &namelist, nullptr, alphasort);
+
+        if (count < 0)
+        {
+            continue;
+        }
+
+        for (int n = 0; n < count; n++)
+        {
+            struct stat stbuf;
+
+            if (stat((dirpath + namelist[n]->d_name).c_str(), &stbuf) == 0 && S_ISREG(stbuf.st_mode))
+            {
+                mix(namelist[n]->d_name, strlen(namelist[n]->d_name));
+                mix(&stbuf.st_size, sizeof(stbuf.st_size));
+                mix(&stbuf.st_mtime, sizeof(stbuf.st_mtime));
+            }
+            free(namelist[n]);
+        }
+        free(namelist);
+    }
+
+    return stamp;
+}
+
 /**
  * @brief Filter function used for scandir.
  *
@@ -747,14 +926,24 @@ static int make_hls_fileset(void * buf, fuse_fill_dir_t filler, const std::strin
         //"#EXT-X-STREAM-INF:PROGRAM-ID=1,BANDWIDTH=61000,CODECS= \"mp4a.40.2 \",CLOSED-CAPTIONS=NONE\n"
         //"index_3_a.m3u8\n";
 
+        // BANDWIDTH is required for each rendition, estimate it from the predicted size.
+        uint64_t bandwidth = 0;
+        if (virtualfile->m_duration > 0)
+        {
+            bandwidth = static_cast<uint64_t>(av_rescale(static_cast<int64_t>(virtualfile->m_predicted_size) * 8, AV_TIME_BASE, virtualfile->m_duration));
+        }
+
         master_contents =
-                "#EXTM3U\n"
-                "#EXT-X-STREAM-INF:PROGRAM-ID=1\n"
+                "#EXTM3U\n";
+        master_contents += string_format("#EXT-X-STREAM-INF:PROGRAM-ID=1,BANDWIDTH=%" PRIu64 "\n", bandwidth);
+        master_contents +=
                 "index_0_av.m3u8\n";
 
         index_0_av_contents =
-                "#EXTM3U\n"
-                "#EXT-X-TARGETDURATION:10\n"
+                "#EXTM3U\n";
+        // Must be the maximum segment duration, rounded to the nearest integer
+        index_0_av_contents += string_format("#EXT-X-TARGETDURATION:%" PRId64 "\n", (params.m_segment_duration + AV_TIME_BASE / 2) / AV_TIME_BASE);
+        index_0_av_contents +=
                 "#EXT-X-ALLOW-CACHE:YES\n"
                 "#EXT-X-PLAYLIST-TYPE:VOD\n"
                 "#EXT-X-VERSION:3\n"
@@ -772,9 +961,8 @@ static int make_hls_fileset(void * buf, fuse_fill_dir_t filler, const std::strin
             //**< @todo; Rework this test code
             struct stat stbuf;
             std::string cachefile;
-            std::string _origpath(origpath);
-            remove_sep(&_origpath);
-            Buffer::make_cachefile_name(cachefile, _origpath + "." + segment_name, params.current_format(virtualfile)->fileext(), false);
+            // Same name as used by the buffer, based on the source file
+            Buffer::make_cachefile_name(cachefile, virtualfile->m_origfile + "." + segment_name, params.current_format(virtualfile)->fileext(), false);
 
             if (!lstat(cachefile.c_str(), &stbuf))
             {
@@ -810,9 +998,11 @@ static int make_hls_fileset(void * buf, fuse_fill_dir_t filler, const std::strin
         index_0_av_contents += "#EXT-X-ENDLIST\n";
 
         child_file = make_file(buf, filler, VIRTUALTYPE_SCRIPT, origpath, "master.m3u8", master_contents.size(), virtualfile->m_st.st_ctime);
+        child_file->m_file_contents.clear();
         std::copy(master_contents.begin(), master_contents.end(), std::back_inserter(child_file->m_file_contents));
 
         child_file = make_file(buf, filler, VIRTUALTYPE_SCRIPT, origpath, "index_0_av.m3u8", index_0_av_contents.size(), virtualfile->m_st.st_ctime, VIRTUALFLAG_NONE);
+        child_file->m_file_contents.clear();
         std::copy(index_0_av_contents.begin(), index_0_av_contents.end(), std::back_inserter(child_file->m_file_contents));
 
         {
@@ -867,6 +1057,275 @@ static int make_hls_fileset(void * buf, fuse_fill_dir_t filler, const std::strin
     return 0;
 }
 
+/**
+ * @brief Get a directory entry, add transcoded files to the virtual files.
+ * @param[in] origpath - Physical path of directory, with trailing separator.
+ * @param[in] origname - Name of file in directory.
+ * @param[out] entry - Directory entry, as shown by FUSE.
+ * @return Returns true on success; false if the file could not be accessed, e.g. because it has been deleted meanwhile.
+ */
+static bool make_dirent(const std::string & origpath, const std::string & origname, DIRENTRY * entry)
+{
+    std::string origfile(origpath + origname);
+    std::string filename(origname);
+    struct stat stbuf;
+
+    if (lstat(origfile.c_str(), &stbuf) == -1)
+    {
+        return false;
+    }
+
+    if (S_ISREG(stbuf.st_mode) || S_ISLNK(stbuf.st_mode))
+    {
+        FFmpegfs_Format *current_format = nullptr;
+        VIRTUALTYPE type = VIRTUALTYPE_DISK;
+        std::string origext;
+
+        if (RemoteIO::is_link(filename))
+        {
+            // Link to remote file: name it after the remote file, remote files are always transcoded
+            remove_ext(&filename);
+            type = VIRTUALTYPE_REMOTE;
+        }
+
+        std::string sourcename(filename);
+
+        find_ext(&origext, filename);
+
+        if (transcoded_name(&filename, &current_format))
+        {
+            std::string newext;
+            find_ext(&newext, filename);
+
+            if (!current_format->is_multiformat())
+            {
+                if (origext != newext || params.m_recodesame == RECODESAME_YES || type == VIRTUALTYPE_REMOTE)
+                {
+                    insert_file(type, origpath + filename, origfile, &stbuf);
+                }
+                else
+                {
+                    insert_file(VIRTUALTYPE_DISK, origpath + filename, origfile, &stbuf, VIRTUALFLAG_PASSTHROUGH);
+                }
+            }
+            else
+            {
+                int flags = VIRTUALFLAG_FILESET | VIRTUALFLAG_DIRECTORY;
+
+                // Change file to directory for the frame set
+                stbuf.st_mode &=  ~static_cast<mode_t>(S_IFREG | S_IFLNK);
+                stbuf.st_mode |=  S_IFDIR;
+                stbuf.st_size = stbuf.st_blksize;
+
+                filename = sourcename;	// Restore source name, without the extension of a remote link
+
+                if (current_format->is_frameset())
+                {
+                    flags |= VIRTUALFLAG_FRAME;
+                }
+                else if (current_format->is_hls())
+                {
+                    flags |= VIRTUALFLAG_HLS;
+                }
+
+                insert_file(type, origpath + filename, origfile, &stbuf, flags);
+            }
+        }
+        else
+        {
+            filename = origname;	// Restore original name
+        }
+    }
+
+    entry->m_origname   = origname;
+    entry->m_name       = filename;
+    memcpy(&entry->m_st, &stbuf, sizeof(struct stat));
+
+    return true;
+}
+
+/**
+ * @brief Check if a cached listing is still valid.
+ *
+ * The directory time changes whenever files are added, removed or renamed. If it is in the
+ * second the listing was made, later changes in the same second would go unnoticed, so the
+ * listing is not trusted.
+ *
+ * @param[in] listing - Cached listing.
+ * @param[in] dirstat - stat of directory.
+ * @return Returns true if the listing is valid.
+ */
+static bool dirlisting_valid(const DIRLISTING & listing, const struct stat & dirstat)
+{
+    return (listing.m_mtime.tv_sec == dirstat.st_mtim.tv_sec && listing.m_mtime.tv_nsec == dirstat.st_mtim.tv_nsec &&
+            listing.m_ctime.tv_sec == dirstat.st_ctim.tv_sec && listing.m_ctime.tv_nsec == dirstat.st_ctim.tv_nsec &&
+            listing.m_ino == dirstat.st_ino &&
+            dirstat.st_mtim.tv_sec < listing.m_listed);
+}
+
+/**
+ * @brief List a directory, using the cached listing if possible.
+ *
+ * Unchanged directories are served from the cache without accessing the files. If the directory
+ * has changed, it is read again, but only new files are examined. If the source watcher runs,
+ * files changed in place are examined again, too.
+ *
+ * @param[in] origpath - Physical path of directory, with trailing separator.
+ * @param[in] buf - FUSE buffer to fill.
+ * @param[in] filler - Filler function.
+ * @return On success, returns 0. On error, returns -errno.
+ */
+static int list_directory(const std::string & origpath, void *buf, fuse_fill_dir_t filler)
+{
+    struct stat dirstat;
+    uint64_t checked;
+
+    if (stat(origpath.c_str(), &dirstat) == -1)
+    {
+        return -errno;
+    }
+
+    watcher_add(origpath);
+
+    // Take before listing, changes while listing will be seen next time
+    checked = watcher_sequence();
+
+    std::shared_ptr<DIRLISTING> listing;
+    uint64_t last_checked = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(dirlistings_mutex);
+
+        dirlistingmap::const_iterator it = dirlistings.find(origpath);
+        if (it != dirlistings.cend())
+        {
+            listing         = it->second;
+            last_checked    = listing->m_checked;
+        }
+    }
+
+    // Read the directory and examine files without the lock, so that a slow directory does not hold up others
+    std::shared_ptr<DIRLISTING> newlisting;
+
+    if (listing != nullptr && dirlisting_valid(*listing, dirstat))
+    {
+        if (checked)
+        {
+            // Pick up files changed in place
+            for (size_t n = 0; n < listing->m_entries.size(); n++)
+            {
+                const DIRENTRY & entry = listing->m_entries[n];
+
+                if (!watcher_unchanged(origpath + entry.m_origname, last_checked))
+                {
+                    if (newlisting == nullptr)
+                    {
+                        newlisting = std::make_shared<DIRLISTING>(*listing);
+                    }
+                    make_dirent(origpath, entry.m_origname, &newlisting->m_entries[n]);
+                }
+            }
+        }
+    }
+    else
+    {
+        DIR *dp = opendir(origpath.c_str());
+        if (dp == nullptr)
+        {
+            return -errno;
+        }
+
+        // Entries already known, by name
+        std::unordered_map<std::string, const DIRENTRY *> known;
+        if (listing != nullptr)
+        {
+            known.reserve(listing->m_entries.size());
+            for (const DIRENTRY & entry : listing->m_entries)
+            {
+                known[entry.m_origname] = &entry;
+            }
+        }
+
+        struct dirent *de;
+
+        newlisting = std::make_shared<DIRLISTING>();
+        newlisting->m_listed = time(nullptr);
+
+        while ((de = readdir(dp)) != nullptr)
+        {
+            std::string origname(de->d_name);
+            std::unordered_map<std::string, const DIRENTRY *>::const_iterator it_known = known.find(origname);
+            DIRENTRY entry;
+
+            // Replaced by a different file of the same name if the inode differs
+            if (it_known != known.cend() && de->d_ino == it_known->second->m_st.st_ino && (!checked || watcher_unchanged(origpath + origname, last_checked)))
+            {
+                entry = *it_known->second;
+            }
+            else if (!make_dirent(origpath, origname, &entry))
+            {
+                // Deleted meanwhile
+                continue;
+            }
+
+            newlisting->m_entries.push_back(std::move(entry));
+        }
+
+        closedir(dp);
+
+        newlisting->m_mtime  = dirstat.st_mtim;
+        newlisting->m_ctime  = dirstat.st_ctim;
+        newlisting->m_ino    = dirstat.st_ino;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(dirlistings_mutex);
+
+        if (newlisting != nullptr)
+        {
+            dirlistingmap::iterator it = dirlistings.find(origpath);
+
+            if (it == dirlistings.end())
+            {
+                // Drop the least recently used listing if the cache is full
+                if (dirlistings.size() >= params.m_readdir_cache)
+                {
+                    dirlistingmap::iterator oldest = dirlistings.begin();
+                    for (dirlistingmap::iterator it_dir = dirlistings.begin(); it_dir != dirlistings.end(); it_dir++)
+                    {
+                        if (it_dir->second->m_last_used < oldest->second->m_last_used)
+                        {
+                            oldest = it_dir;
+                        }
+                    }
+                    dirlistings.erase(oldest);
+                }
+
+                dirlistings.insert(std::make_pair(origpath, newlisting));
+            }
+            else
+            {
+                it->second = newlisting;
+            }
+
+            listing = newlisting;
+        }
+
+        listing->m_checked      = checked;
+        listing->m_last_used    = time(nullptr);
+    }
+
+    for (const DIRENTRY & entry : listing->m_entries)
+    {
+        if (filler(buf, entry.m_name.c_str(), &entry.m_st, 0))
+        {
+            break;
+        }
+    }
+
+    return 0;
+}
+
 /**
  * @brief Read directory
  * @param[in] path - Physical path to load.
@@ -926,86 +1385,36 @@ static int ffmpegfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 
     if (virtualfile == nullptr || !(virtualfile->m_flags & VIRTUALFLAG_FILESET))
     {
-        DIR *dp = opendir(origpath.c_str());
-        if (dp != nullptr)
+        if (params.m_readdir_cache)
+        {
+            int ret = list_directory(origpath, buf, filler);
+            if (ret < 0)
+            {
+                return ret;
+            }
+            errno = 0;  // Just to make sure - reset any error
+        }
+        else
         {
-            try
+            DIR *dp = opendir(origpath.c_str());
+            if (dp != nullptr)
             {
+                watcher_add(origpath);
+
                 while ((de = readdir(dp)) != nullptr)
                 {
-                    std::string origname(de->d_name);
-                    std::string origfile;
-                    std::string filename(de->d_name);
-                    struct stat stbuf;
-
-                    origfile = origpath + origname;
-
-                    if (lstat(origfile.c_str(), &stbuf) == -1)
-                    {
-                        throw false;
-                    }
-
-                    if (S_ISREG(stbuf.st_mode) || S_ISLNK(stbuf.st_mode))
-                    {
-                        FFmpegfs_Format *current_format = nullptr;
-                        std::string origext;
-                        find_ext(&origext, filename);
-
-                        if (transcoded_name(&filename, &current_format))
-                        {
-                            std::string newext;
-                            find_ext(&newext, filename);
-
-                            if (!current_format->is_multiformat())
-                            {
-                                if (origext != newext || params.m_recodesame == RECODESAME_YES)
-                                {
-                                    insert_file(VIRTUALTYPE_DISK, origpath + filename, origfile, &stbuf);
-                                }
-                                else
-                                {
-                                    insert_file(VIRTUALTYPE_DISK, origpath + filename, origfile, &stbuf, VIRTUALFLAG_PASSTHROUGH);
-                                }
-                            }
-                            else
-                            {
-                                int flags = VIRTUALFLAG_FILESET | VIRTUALFLAG_DIRECTORY;
-
-                                // Change file to directory for the frame set
-                                stbuf.st_mode &=  ~static_cast<mode_t>(S_IFREG | S_IFLNK);
-                                stbuf.st_mode |=  S_IFDIR;
-                                stbuf.st_size = stbuf.st_blksize;
-
-                                filename = origname;	// Restore original name
-
-                                if (current_format->is_frameset())
-                                {
-                                    flags |= VIRTUALFLAG_FRAME;
-                                }
-                                else if (current_format->is_hls())
-                                {
-                                    flags |= VIRTUALFLAG_HLS;
-                                }
-
-                                insert_file(VIRTUALTYPE_DISK, origfile, &stbuf, flags);
-                            }
-                        }
-                    }
+                    DIRENTRY entry;
 
-                    if (filler(buf, filename.c_str(), &stbuf, 0))
+                    if (make_dirent(origpath, de->d_name, &entry) && filler(buf, entry.m_name.c_str(), &entry.m_st, 0))
                     {
                         break;
                     }
                 }
-            }
-            catch (bool)
-            {
-
-            }
 
-            closedir(dp);
+                closedir(dp);
 
-            errno = 0;  // Just to make sure - reset any error
+                errno = 0;  // Just to make sure - reset any error
+            }
         }
     }
     else
@@ -1145,6 +1554,7 @@ static int ffmpegfs_getattr(const char *path, struct stat *stbuf)
         no_check = true;    // FILETYPE already known, no need to check again.
         [[clang::fallthrough]];
     }
+    case VIRTUALTYPE_REMOTE:
     case VIRTUALTYPE_DISK:
     {
         if (virtualfile != nullptr && (flags & (VIRTUALFLAG_FRAME | VIRTUALFLAG_HLS | VIRTUALFLAG_DIRECTORY)))
@@ -1411,6 +1821,7 @@ static int ffmpegfs_fgetattr(const char *path, struct stat * stbuf, struct fuse_
         no_check = true;
         [[clang::fallthrough]];
     }
+    case VIRTUALTYPE_REMOTE:
     case VIRTUALTYPE_DISK:
     {
         if (virtualfile->m_flags & (VIRTUALFLAG_FILESET | VIRTUALFLAG_FRAME | VIRTUALFLAG_HLS | VIRTUALFLAG_DIRECTORY))
@@ -1530,6 +1941,7 @@ static int ffmpegfs_open(const char *path, struct fuse_file_info *fi)
 #ifdef USE_LIBBLURAY
     case VIRTUALTYPE_BLURAY:
 #endif // USE_LIBBLURAY
+    case VIRTUALTYPE_REMOTE:
     case VIRTUALTYPE_DISK:
     {
         if (virtualfile->m_flags & (VIRTUALFLAG_FRAME | VIRTUALFLAG_HLS))
@@ -1673,6 +2085,7 @@ static int ffmpegfs_read(const char *path, char *buf, size_t size, off_t _offset
 #ifdef USE_LIBBLURAY
     case VIRTUALTYPE_BLURAY:
 #endif // USE_LIBBLURAY
+    case VIRTUALTYPE_REMOTE:
     case VIRTUALTYPE_DISK:
     {
         if (virtualfile->m_flags & VIRTUALFLAG_FRAME)
@@ -1872,6 +2285,22 @@ static void *ffmpegfs_init(struct fuse_conn_info *conn)
         }
     }
 
+    if (params.m_shared_sessions)
+    {
+        if (!start_shared_sessions())
+        {
+            Logging::warning(nullptr, "Shared transcoder sessions are not available, every process transcodes on its own.");
+        }
+    }
+
+    if (params.m_watch_sources)
+    {
+        if (!start_watcher())
+        {
+            Logging::warning(nullptr, "Source watcher is not available, checking source files on every open.");
+        }
+    }
+
     if (params.m_enablescript)
     {
         prepare_script();
@@ -1882,8 +2311,19 @@ static void *ffmpegfs_init(struct fuse_conn_info *conn)
         tp = new(std::nothrow)thread_pool(params.m_max_threads);
     }
 
+    if (params.m_numa)
+    {
+        tp->enable_numa();
+    }
+
+    tp->set_max_busy(params.m_max_transcoders);
+
     tp->init();
 
+#if defined(USE_LIBDVD) || defined(USE_LIBBLURAY)
+    start_disc_cleanup();
+#endif // USE_LIBDVD || USE_LIBBLURAY
+
     return nullptr;
 }
 
@@ -1898,9 +2338,10 @@ static void ffmpegfs_destroy(__attribute__((unused)) void * p)
 
     stop_cache_maintenance();
 
+    transcoder_drain();
     transcoder_exit();
-    transcoder_free();
 
+    // Threads must be gone before the cache is freed
     if (tp != nullptr)
     {
         tp->tear_down();
@@ -1908,6 +2349,23 @@ static void ffmpegfs_destroy(__attribute__((unused)) void * p)
         tp = nullptr;
     }
 
+    transcoder_free();
+
+    // Close discs kept open for later use
+#if defined(USE_LIBDVD) || defined(USE_LIBBLURAY)
+    stop_disc_cleanup();
+#endif // USE_LIBDVD || USE_LIBBLURAY
+#ifdef USE_LIBDVD
+    DvdIO::cleanup(true);
+#endif // USE_LIBDVD
+#ifdef USE_LIBBLURAY
+    BlurayIO::cleanup(true);
+#endif // USE_LIBBLURAY
+
+    stop_shared_sessions();
+
+    stop_watcher();
+
     script_file.clear();
 
     Logging::info(nullptr, "%1 V%2 terminated", PACKAGE_NAME, FFMPEFS_VERSION);
@@ -1931,3 +2389,53 @@ static std::string get_number(const char *path, uint32_t *value)
     return filename;
 }
 
+#if defined(USE_LIBDVD) || defined(USE_LIBBLURAY)
+/**
+ * @brief Periodically close disc handles that were not used for a while.
+ * Runs in its own thread: closing a disc frees memory and logs, which must not be done in a signal handler.
+ */
+static void disc_cleanup_loop()
+{
+    std::unique_lock<std::mutex> lock(disc_cleanup_mutex);
+
+    while (!disc_cleanup_cond.wait_for(lock, std::chrono::seconds(DISC_CLEANUP_INTERVAL), []{ return disc_cleanup_stop; }))
+    {
+        lock.unlock();
+#ifdef USE_LIBDVD
+        DvdIO::cleanup(false);
+#endif // USE_LIBDVD
+#ifdef USE_LIBBLURAY
+        BlurayIO::cleanup(false);
+#endif // USE_LIBBLURAY
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Start the thread that closes unused disc handles.
+ */
+static void start_disc_cleanup()
+{
+    disc_cleanup_stop = false;
+    disc_cleanup_thread = std::thread(disc_cleanup_loop);
+}
+
+/**
+ * @brief Stop the thread that closes unused disc handles.
+ */
+static void stop_disc_cleanup()
+{
+    if (!disc_cleanup_thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(disc_cleanup_mutex);
+        disc_cleanup_stop = true;
+    }
+    disc_cleanup_cond.notify_all();
+
+    disc_cleanup_thread.join();
+}
+#endif // USE_LIBDVD || USE_LIBBLURAY
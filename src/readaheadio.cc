@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * On Debian systems, the complete text of the GNU General Public License
+ * Version 3 can be found in `/usr/share/common-licenses/GPL-3'.
+ */
+
+/**
+ * @file
+ * @brief ReadAheadIO class implementation
+ *
+ * @ingroup ffmpegfs
+ *
+ * @author Norbert Schlia (nschlia@oblivion-software.de)
+ * @copyright Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ */
+
+#include "readaheadio.h"
+#include "logging.h"
+
+#include <string.h>
+#include <algorithm>
+
+ReadAheadIO::ReadAheadIO(FileIO * source, unsigned int blocks)
+    : m_source(source)
+    , m_blocks(blocks ? blocks : 1)
+    , m_offset(0)
+    , m_pos(0)
+    , m_generation(0)
+    , m_started(false)
+    , m_source_eof(false)
+    , m_source_error(0)
+    , m_eof(false)
+    , m_error(0)
+    , m_stop(false)
+{
+
+}
+
+ReadAheadIO::~ReadAheadIO()
+{
+    close();
+    delete m_source;
+}
+
+VIRTUALTYPE ReadAheadIO::type() const
+{
+    return m_source->type();
+}
+
+size_t ReadAheadIO::bufsize() const
+{
+    return m_source->bufsize();
+}
+
+int ReadAheadIO::open(LPVIRTUALFILE virtualfile)
+{
+    set_virtualfile(virtualfile);
+
+    int ret = m_source->open(virtualfile);
+    if (ret)
+    {
+        return ret;
+    }
+
+    m_queue.clear();
+    m_offset        = 0;
+    m_pos           = m_source->tell();
+    m_started       = false;
+    m_source_eof    = false;
+    m_source_error  = 0;
+    m_eof           = false;
+    m_error         = 0;
+    m_stop          = false;
+
+    try
+    {
+        m_thread = std::thread(&ReadAheadIO::fetch_thread, this);
+    }
+    catch (std::system_error & e)
+    {
+        Logging::error(filename(), "Unable to start read ahead thread: %1", e.what());
+        m_source->close();
+        return e.code().value();
+    }
+
+    return 0;
+}
+
+size_t ReadAheadIO::read(void * data, size_t size)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    size_t bytes = 0;
+
+    if (!m_started)
+    {
+        m_started = true;
+        m_cond.notify_all();
+    }
+
+    m_cond.wait(lock, [this]{ return (!m_queue.empty() || m_source_eof || m_source_error || m_stop); });
+
+    if (m_queue.empty())
+    {
+        if (m_source_error)
+        {
+            m_error = errno = m_source_error;
+        }
+        else
+        {
+            m_eof = true;
+        }
+        return 0;
+    }
+
+    while (bytes < size && !m_queue.empty())
+    {
+        BLOCK & block = m_queue.front();
+        size_t len = std::min(size - bytes, block.m_size - m_offset);
+
+        memcpy(static_cast<uint8_t *>(data) + bytes, block.m_data.data() + m_offset, len);
+
+        bytes       += len;
+        m_offset    += len;
+
+        if (m_offset >= block.m_size)
+        {
+            m_queue.pop_front();
+            m_offset = 0;
+        }
+    }
+
+    m_pos += bytes;
+
+    if (m_queue.empty() && m_source_eof)
+    {
+        // All read, the next call reports EOF instead of returning 0
+        m_eof = true;
+    }
+
+    // Room for more blocks
+    m_cond.notify_all();
+
+    return bytes;
+}
+
+int ReadAheadIO::error() const
+{
+    return m_error;
+}
+
+int64_t ReadAheadIO::duration() const
+{
+    std::lock_guard<std::mutex> lock_io(m_io_mutex);
+    return m_source->duration();
+}
+
+size_t ReadAheadIO::size() const
+{
+    std::lock_guard<std::mutex> lock_io(m_io_mutex);
+    return m_source->size();
+}
+
+size_t ReadAheadIO::tell() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pos;
+}
+
+int ReadAheadIO::seek(int64_t offset, int whence)
+{
+    // Wait for a read in progress to finish, then keep the thread off the source
+    std::lock_guard<std::mutex> lock_io(m_io_mutex);
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (whence == SEEK_CUR)
+    {
+        // The source is ahead of us, seek relative to what the caller has read
+        offset += static_cast<int64_t>(m_pos);
+        whence = SEEK_SET;
+    }
+
+    // Drop blocks read ahead and a read that has not been queued yet
+    m_generation++;
+    m_queue.clear();
+    m_offset = 0;
+
+    int ret = m_source->seek(offset, whence);
+
+    if (!ret)
+    {
+        m_pos           = m_source->tell();
+        m_source_eof    = false;
+        m_source_error  = 0;
+        m_eof           = false;
+    }
+
+    m_cond.notify_all();
+
+    return ret;
+}
+
+bool ReadAheadIO::eof() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_eof;
+}
+
+void ReadAheadIO::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_cond.notify_all();
+    }
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+
+    m_queue.clear();
+
+    m_source->close();
+}
+
+void ReadAheadIO::fetch_thread()
+{
+    const size_t blocksize = m_source->bufsize();
+
+    while (true)
+    {
+        unsigned int generation;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            m_cond.wait(lock, [this]{ return (m_stop || (m_started && m_queue.size() < m_blocks && !m_source_eof && !m_source_error)); });
+
+            if (m_stop)
+            {
+                break;
+            }
+
+            generation = m_generation;
+        }
+
+        BLOCK block;
+        int error = 0;
+
+        block.m_data.resize(blocksize);
+
+        {
+            std::lock_guard<std::mutex> lock_io(m_io_mutex);
+
+            if (generation != m_generation)
+            {
+                // Seek happened, start over at the new position
+                continue;
+            }
+
+            block.m_size = m_source->read(block.m_data.data(), blocksize);
+
+            if (!block.m_size)
+            {
+                error = m_source->error();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (generation != m_generation)
+        {
+            // Seek while reading, drop the result
+            continue;
+        }
+
+        if (block.m_size)
+        {
+            m_queue.emplace_back(std::move(block));
+        }
+        else if (error)
+        {
+            Logging::error(filename(), "Read ahead failed (%1) %2", error, strerror(error));
+            m_source_error = error;
+        }
+        else
+        {
+            m_source_eof = true;
+        }
+
+        m_cond.notify_all();
+    }
+}
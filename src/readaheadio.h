@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * On Debian systems, the complete text of the GNU General Public License
+ * Version 3 can be found in `/usr/share/common-licenses/GPL-3'.
+ */
+
+/**
+ * @file
+ * @brief Asynchronous read ahead for input files
+ *
+ * Wraps another FileIO object and reads from it in a separate thread,
+ * keeping a ring of blocks filled ahead of the current position. This
+ * way the decoder does not stall while slow storage (NAS, spinning
+ * disks, other FUSE file systems) delivers the next block.
+ *
+ * @ingroup ffmpegfs
+ *
+ * @author Norbert Schlia (nschlia@oblivion-software.de)
+ * @copyright Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ */
+
+#ifndef READAHEADIO_H
+#define READAHEADIO_H
+
+#pragma once
+
+#include "fileio.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+
+/** @brief Read ahead I/O class
+ */
+class ReadAheadIO : public FileIO
+{
+    /**
+     * @brief One block read from the source
+     */
+    typedef struct BLOCK
+    {
+        std::vector<uint8_t>    m_data;                         /**< @brief Block data */
+        size_t                  m_size;                         /**< @brief Number of valid bytes in m_data */
+    } BLOCK;
+
+public:
+    /**
+     * @brief Create #ReadAheadIO object
+     * @param[in] source - FileIO object to read from. Will be deleted together with this object.
+     * @param[in] blocks - Number of blocks to read ahead.
+     */
+    explicit ReadAheadIO(FileIO * source, unsigned int blocks);
+    virtual ~ReadAheadIO();
+
+    /**
+     * @brief Get type of the virtual file
+     * @return Returns the type of the source.
+     */
+    virtual VIRTUALTYPE type() const;
+    /**
+     * @brief Get the ideal buffer size.
+     * @return Return the ideal buffer size of the source.
+     */
+    virtual size_t  bufsize() const;
+
+    /** @brief Open a file and start the read ahead thread
+     * @param[in] virtualfile - LPCVIRTUALFILE of file to open
+     * @return Upon successful completion, #open() returns 0. @n
+     * On error, an nonzero value is returned and errno is set to indicate the error.
+     */
+    virtual int     open(LPVIRTUALFILE virtualfile);
+    /** @brief Read data from file
+     *
+     * Takes the data from the read ahead blocks, waits for the thread if none is available yet.
+     *
+     * @param[out] data - buffer to store read bytes in. Must be large enough to hold up to size bytes.
+     * @param[in] size - number of bytes to read
+     * @return Upon successful completion, #read() returns the number of bytes read. @n
+     * This may be less than size. @n
+     * On error, the value 0 is returned and errno is set to indicate the error. @n
+     * If at end of file, 0 may be returned by errno not set. error() will return 0 if at EOF.
+     */
+    virtual size_t  read(void *data, size_t size);
+    /**
+     * @brief Get last error.
+     * @return errno value of last error.
+     */
+    virtual int     error() const;
+    /** @brief Get the duration of the file, in AV_TIME_BASE fractional seconds.
+     * @return Returns the duration reported by the source.
+     */
+    virtual int64_t duration() const;
+    /**
+     * @brief Get the file size.
+     * @return Returns the file size.
+     */
+    virtual size_t  size() const;
+    /**
+     * @brief Get current read position.
+     * @return Gets the current read position.
+     */
+    virtual size_t  tell() const;
+    /** @brief Seek to position in file
+     *
+     * Blocks read ahead are dropped, a read in progress is waited for and its result discarded.
+     *
+     * @param[in] offset - offset in bytes
+     * @param[in] whence - how to seek: @n
+     * SEEK_SET: The offset is set to offset bytes. @n
+     * SEEK_CUR: The offset is set to its current location plus offset bytes. @n
+     * SEEK_END: The offset is set to the size of the file plus offset bytes.
+     * @return Upon successful completion, #seek() returns 0. @n
+     * On error, the value -1 is returned and errno is set to indicate the error.
+     */
+    virtual int     seek(int64_t offset, int whence);
+    /**
+     * @brief Check if at end of file.
+     * @return Returns true if at end of file.
+     */
+    virtual bool    eof() const;
+    /**
+     * @brief Stop the read ahead thread and close the source.
+     */
+    virtual void    close();
+
+protected:
+    /**
+     * @brief Read ahead thread: fill up blocks until the ring is full.
+     */
+    void                        fetch_thread();
+
+protected:
+    FileIO *                    m_source;                       /**< @brief FileIO object to read from */
+    unsigned int                m_blocks;                       /**< @brief Max. number of blocks to read ahead */
+    std::thread                 m_thread;                       /**< @brief Read ahead thread */
+    mutable std::mutex          m_mutex;                        /**< @brief Protects the block queue and state below */
+    mutable std::mutex          m_io_mutex;                     /**< @brief Serialises access to the source */
+    std::condition_variable     m_cond;                         /**< @brief Signalled when blocks are added or removed, or on seek and close */
+    std::deque<BLOCK>           m_queue;                        /**< @brief Blocks read ahead, front is at m_pos - m_offset */
+    size_t                      m_offset;                       /**< @brief Bytes already consumed from the front block */
+    size_t                      m_pos;                          /**< @brief Current read position */
+    std::atomic_uint            m_generation;                   /**< @brief Incremented on each seek, reads of older generations are dropped */
+    bool                        m_started;                      /**< @brief Set on first read, avoids reading ahead when only probing the file */
+    bool                        m_source_eof;                   /**< @brief Source has reached the end of file */
+    int                         m_source_error;                 /**< @brief errno value of a source read error, 0 if none */
+    bool                        m_eof;                          /**< @brief True if the last read hit the end of file */
+    int                         m_error;                        /**< @brief errno value of last read error, 0 if none */
+    bool                        m_stop;                         /**< @brief Set to stop the read ahead thread */
+};
+
+#endif // READAHEADIO_H
@@ -0,0 +1,491 @@
+/*
+ * Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * On Debian systems, the complete text of the GNU General Public License
+ * Version 3 can be found in `/usr/share/common-licenses/GPL-3'.
+ */
+
+/**
+ * @file
+ * @brief RemoteIO class implementation
+ *
+ * @ingroup ffmpegfs
+ *
+ * @author Norbert Schlia (nschlia@oblivion-software.de)
+ * @copyright Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ */
+
+#include "remoteio.h"
+#include "ffmpegfs.h"
+#include "ffmpeg_utils.h"
+#include "logging.h"
+
+#include <string.h>
+#include <fstream>
+#include <algorithm>
+
+RemoteIO::RemoteIO()
+    : m_size(0)
+    , m_pos(0)
+    , m_eof(false)
+    , m_error(0)
+    , m_connections(1)
+    , m_cache_blocks(0)
+    , m_access(0)
+    , m_stop(false)
+{
+
+}
+
+RemoteIO::~RemoteIO()
+{
+    close();
+}
+
+bool RemoteIO::is_link(const std::string & filename)
+{
+    std::string ext;
+
+    return (find_ext(&ext, filename) && !strcasecmp(ext, REMOTEIO_LINK_EXT));
+}
+
+bool RemoteIO::read_link(const std::string & filename, std::string * url)
+{
+    std::ifstream file(filename);
+    std::string line;
+
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    // First line that is not empty or a comment
+    while (std::getline(file, line))
+    {
+        trim(line);
+
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        if (line.find("://") == std::string::npos)
+        {
+            break;
+        }
+
+        *url = line;
+        return true;
+    }
+
+    errno = EINVAL;
+    return false;
+}
+
+VIRTUALTYPE RemoteIO::type() const
+{
+    return VIRTUALTYPE_REMOTE;
+}
+
+size_t RemoteIO::bufsize() const
+{
+    return REMOTEIO_BLOCK_SIZE;
+}
+
+int RemoteIO::open(LPVIRTUALFILE virtualfile)
+{
+    AVIOContext *ctx = nullptr;
+    int64_t size;
+    int ret;
+
+    set_virtualfile(virtualfile);
+
+    m_size          = 0;
+    m_pos           = 0;
+    m_eof           = false;
+    m_error         = 0;
+    m_access        = 0;
+    m_stop          = false;
+    m_connections   = std::max(params.m_remote_connections, 1u);
+    // Keep at least the blocks fetched ahead
+    m_cache_blocks  = std::max(params.m_remote_cache / REMOTEIO_BLOCK_SIZE, static_cast<size_t>(m_connections) * 2 + 1);
+
+    if (!read_link(filename(), &m_url))
+    {
+        Logging::error(filename(), "Unable to read URL from link file: (%1) %2", errno, strerror(errno));
+        return errno;
+    }
+
+    Logging::debug(filename(), "Opening remote file '%1'.", m_url.c_str());
+
+    ret = connect(&ctx);
+    if (ret < 0)
+    {
+        Logging::error(filename(), "Could not open remote file '%1' (error '%2').", m_url.c_str(), ffmpeg_geterror(ret).c_str());
+        return EIO;
+    }
+
+    size = avio_size(ctx);
+    if (size < 0 || !(ctx->seekable & AVIO_SEEKABLE_NORMAL))
+    {
+        Logging::error(filename(), "Remote file '%1' has no size or does not support range requests.", m_url.c_str());
+        avio_closep(&ctx);
+        return EINVAL;
+    }
+
+    m_size = static_cast<size_t>(size);
+
+    // The first thread takes over the connection already open
+    for (unsigned int n = 0; n < m_connections; n++)
+    {
+        m_threads.emplace_back(&RemoteIO::fetch_thread, this, !n ? ctx : nullptr);
+    }
+
+    return 0;
+}
+
+int RemoteIO::connect(AVIOContext **ctx)
+{
+    AVDictionary *opt = nullptr;
+    AVIOInterruptCB int_cb = { interrupt_cb, this };
+    int ret;
+
+    // Keep the connection alive for the next range request
+    av_dict_set(&opt, "multiple_requests", "1", 0);
+    av_dict_set(&opt, "reconnect", "1", 0);
+
+    ret = avio_open2(ctx, m_url.c_str(), AVIO_FLAG_READ, &int_cb, &opt);
+
+    av_dict_free(&opt);
+
+    return ret;
+}
+
+int RemoteIO::interrupt_cb(void *opaque)
+{
+    return static_cast<RemoteIO *>(opaque)->m_stop ? 1 : 0;
+}
+
+void RemoteIO::fetch_thread(AVIOContext *ctx)
+{
+    std::vector<uint8_t> data;
+
+    while (true)
+    {
+        size_t block_no;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+
+            if (m_stop)
+            {
+                break;
+            }
+
+            block_no = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        size_t offset   = block_no * REMOTEIO_BLOCK_SIZE;
+        size_t len      = std::min(static_cast<size_t>(REMOTEIO_BLOCK_SIZE), m_size - offset);
+        int ret         = 0;
+
+        data.resize(len);
+
+        if (ctx == nullptr)
+        {
+            ret = connect(&ctx);
+        }
+
+        if (ret >= 0)
+        {
+            // Sends a new range request on the open connection
+            int64_t pos = avio_seek(ctx, static_cast<int64_t>(offset), SEEK_SET);
+            if (pos < 0)
+            {
+                ret = static_cast<int>(pos);
+            }
+        }
+
+        for (size_t bytes = 0; ret >= 0 && bytes < len; bytes += static_cast<size_t>(ret))
+        {
+            ret = avio_read(ctx, data.data() + bytes, static_cast<int>(len - bytes));
+            if (!ret)
+            {
+                ret = AVERROR_EOF;
+            }
+        }
+
+        if (ret < 0)
+        {
+            if (!m_stop)
+            {
+                Logging::error(filename(), "Could not read block at %1 of remote file '%2' (error '%3').", offset, m_url.c_str(), ffmpeg_geterror(ret).c_str());
+            }
+            // Open a new connection for the next request
+            avio_closep(&ctx);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::map<size_t, BLOCK>::iterator it = m_blocks.find(block_no);
+        if (it != m_blocks.end())
+        {
+            it->second.m_data.swap(data);
+            it->second.m_ready = true;
+            it->second.m_error = (ret < 0) ? EIO : 0;
+        }
+        // else: no longer required after a seek
+
+        m_cond.notify_all();
+    }
+
+    if (ctx != nullptr)
+    {
+        avio_closep(&ctx);
+    }
+}
+
+void RemoteIO::request(size_t block_no)
+{
+    size_t blocks   = (m_size + REMOTEIO_BLOCK_SIZE - 1) / REMOTEIO_BLOCK_SIZE;
+    size_t last     = std::min(block_no + m_connections * 2, blocks);
+
+    // Drop requests not yet taken by a thread and no longer in range, e.g. after a seek
+    for (std::deque<size_t>::iterator it = m_queue.begin(); it != m_queue.end();)
+    {
+        if (*it < block_no || *it >= last)
+        {
+            m_blocks.erase(*it);
+            it = m_queue.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+
+    for (size_t n = block_no; n < last; n++)
+    {
+        if (m_blocks.find(n) == m_blocks.end())
+        {
+            BLOCK & block = m_blocks[n];
+
+            block.m_ready       = false;
+            block.m_error       = 0;
+            block.m_last_used   = ++m_access;
+
+            m_queue.push_back(n);
+        }
+    }
+
+    // The block read now goes first
+    std::deque<size_t>::iterator it = std::find(m_queue.begin(), m_queue.end(), block_no);
+    if (it != m_queue.end() && it != m_queue.begin())
+    {
+        m_queue.erase(it);
+        m_queue.push_front(block_no);
+    }
+}
+
+void RemoteIO::evict(size_t block_no)
+{
+    size_t keep_last = block_no + m_connections * 2;
+
+    while (m_blocks.size() > m_cache_blocks)
+    {
+        std::map<size_t, BLOCK>::iterator oldest = m_blocks.end();
+
+        for (std::map<size_t, BLOCK>::iterator it = m_blocks.begin(); it != m_blocks.end(); it++)
+        {
+            // Blocks being fetched and the blocks read next stay
+            if (it->second.m_ready && (it->first < block_no || it->first >= keep_last) &&
+                    (oldest == m_blocks.end() || it->second.m_last_used < oldest->second.m_last_used))
+            {
+                oldest = it;
+            }
+        }
+
+        if (oldest == m_blocks.end())
+        {
+            break;
+        }
+
+        m_blocks.erase(oldest);
+    }
+}
+
+size_t RemoteIO::read(void * data, size_t size)
+{
+    if (m_threads.empty())
+    {
+        m_error = errno = EINVAL;
+        return 0;
+    }
+
+    if (m_pos >= m_size)
+    {
+        m_eof = true;
+        return 0;
+    }
+
+    size_t block_no = m_pos / REMOTEIO_BLOCK_SIZE;
+    size_t offset   = m_pos % REMOTEIO_BLOCK_SIZE;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    request(block_no);
+    m_cond.notify_all();
+
+    m_cond.wait(lock, [this, block_no]
+    {
+        std::map<size_t, BLOCK>::const_iterator it = m_blocks.find(block_no);
+        return m_stop || (it != m_blocks.end() && it->second.m_ready);
+    });
+
+    if (m_stop)
+    {
+        m_error = errno = EINTR;
+        return 0;
+    }
+
+    BLOCK & block = m_blocks[block_no];
+
+    if (block.m_error)
+    {
+        m_error = errno = block.m_error;
+        // Fetch again on next read
+        m_blocks.erase(block_no);
+        return 0;
+    }
+
+    block.m_last_used = ++m_access;
+
+    size_t bytes = 0;
+    if (offset < block.m_data.size())
+    {
+        bytes = std::min(size, block.m_data.size() - offset);
+
+        if (data != nullptr)
+        {
+            memcpy(data, block.m_data.data() + offset, bytes);
+        }
+    }
+
+    m_pos += bytes;
+    m_error = 0;
+
+    if (m_pos >= m_size)
+    {
+        // Report end of file with the last bytes, not with an extra read of 0 bytes
+        m_eof = true;
+    }
+
+    evict(block_no);
+
+    return bytes;
+}
+
+int RemoteIO::error() const
+{
+    return m_error;
+}
+
+int64_t RemoteIO::duration() const
+{
+    return AV_NOPTS_VALUE;  // not applicable
+}
+
+size_t RemoteIO::size() const
+{
+    return m_size;
+}
+
+size_t RemoteIO::tell() const
+{
+    return m_pos;
+}
+
+int RemoteIO::seek(int64_t offset, int whence)
+{
+    int64_t pos;
+
+    switch (whence)
+    {
+    case SEEK_SET:
+    {
+        pos = offset;
+        break;
+    }
+    case SEEK_CUR:
+    {
+        pos = static_cast<int64_t>(m_pos) + offset;
+        break;
+    }
+    case SEEK_END:
+    {
+        pos = static_cast<int64_t>(m_size) + offset;
+        break;
+    }
+    default:
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    }
+
+    if (pos < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Blocks are fetched on the next read
+    m_pos   = static_cast<size_t>(pos);
+    m_eof   = false;
+
+    return 0;
+}
+
+bool RemoteIO::eof() const
+{
+    return m_eof;
+}
+
+void RemoteIO::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_cond.notify_all();
+    }
+
+    // Pending requests are aborted through the interrupt callback
+    for (std::thread & thread : m_threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+    m_threads.clear();
+
+    m_blocks.clear();
+    m_queue.clear();
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * On Debian systems, the complete text of the GNU General Public License
+ * Version 3 can be found in `/usr/share/common-licenses/GPL-3'.
+ */
+
+/**
+ * @file
+ * @brief Remote file I/O
+ *
+ * Reads sources from HTTP servers or S3 compatible object stores. A source
+ * is represented by a link file with the extension .url in the input
+ * directory, containing the URL of the object. The object is read in
+ * blocks by HTTP range requests, several blocks ahead of the decoder
+ * over parallel keep-alive connections. Blocks are kept in a local cache
+ * so that seeks back, e.g. when probing the file, do not fetch them again.
+ *
+ * @ingroup ffmpegfs
+ *
+ * @author Norbert Schlia (nschlia@oblivion-software.de)
+ * @copyright Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ */
+
+#ifndef REMOTEIO_H
+#define REMOTEIO_H
+
+#pragma once
+
+#include "fileio.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+
+#define REMOTEIO_LINK_EXT       "url"                           /**< @brief Extension of link files */
+#define REMOTEIO_BLOCK_SIZE     (1024 * 1024)                   /**< @brief Size of a block fetched with one range request */
+
+struct AVIOContext;
+
+/** @brief Remote I/O class
+ */
+class RemoteIO : public FileIO
+{
+    /**
+     * @brief One block of the remote file
+     */
+    typedef struct BLOCK
+    {
+        std::vector<uint8_t>    m_data;                         /**< @brief Block data, empty while the block is fetched */
+        bool                    m_ready;                        /**< @brief True if the block has been fetched */
+        int                     m_error;                        /**< @brief errno value if fetching the block failed, 0 if none */
+        uint64_t                m_last_used;                    /**< @brief Access counter value of last use, for cache eviction */
+    } BLOCK;
+
+public:
+    explicit RemoteIO();
+    virtual ~RemoteIO();
+
+    /**
+     * @brief Check if a file is a link to a remote file.
+     * @param[in] filename - Name of file to check.
+     * @return Returns true if the file has the extension of link files.
+     */
+    static bool     is_link(const std::string & filename);
+    /**
+     * @brief Read the URL from a link file.
+     * @param[in] filename - Name of link file.
+     * @param[out] url - URL of remote file.
+     * @return Returns true on success, false if the file could not be read or contains no URL. errno is set on error.
+     */
+    static bool     read_link(const std::string & filename, std::string * url);
+
+    /**
+     * @brief Get type of the virtual file
+     * @return Returns the type of the virtual file.
+     */
+    virtual VIRTUALTYPE type() const;
+    /**
+     * @brief Get the ideal buffer size.
+     * @return Return the ideal buffer size.
+     */
+    virtual size_t  bufsize() const;
+
+    /** @brief Open a remote file
+     *
+     * Reads the URL from the link file and gets the size of the remote file.
+     *
+     * @param[in] virtualfile - LPCVIRTUALFILE of link file to open
+     * @return Upon successful completion, #open() returns 0. @n
+     * On error, an nonzero value is returned and errno is set to indicate the error.
+     */
+    virtual int     open(LPVIRTUALFILE virtualfile);
+    /** @brief Read data from file
+     *
+     * Takes the data from the block cache, waits for the block if it is not yet available.
+     *
+     * @param[out] data - buffer to store read bytes in. Must be large enough to hold up to size bytes.
+     * @param[in] size - number of bytes to read
+     * @return Upon successful completion, #read() returns the number of bytes read. @n
+     * This may be less than size. @n
+     * On error, the value 0 is returned and errno is set to indicate the error. @n
+     * If at end of file, 0 may be returned by errno not set. error() will return 0 if at EOF.
+     */
+    virtual size_t  read(void *data, size_t size);
+    /**
+     * @brief Get last error.
+     * @return errno value of last error.
+     */
+    virtual int     error() const;
+    /** @brief Get the duration of the file, in AV_TIME_BASE fractional seconds.
+     *
+     * Not applicable, always returns AV_NOPTS_VALUE.
+     *
+     * @return Returns AV_NOPTS_VALUE.
+     */
+    virtual int64_t duration() const;
+    /**
+     * @brief Get the file size.
+     * @return Returns the file size.
+     */
+    virtual size_t  size() const;
+    /**
+     * @brief Get current read position.
+     * @return Gets the current read position.
+     */
+    virtual size_t  tell() const;
+    /** @brief Seek to position in file
+     *
+     * Only sets the read position, blocks are fetched when read.
+     *
+     * @param[in] offset - offset in bytes
+     * @param[in] whence - how to seek: @n
+     * SEEK_SET: The offset is set to offset bytes. @n
+     * SEEK_CUR: The offset is set to its current location plus offset bytes. @n
+     * SEEK_END: The offset is set to the size of the file plus offset bytes.
+     * @return Upon successful completion, #seek() returns 0. @n
+     * On error, the value -1 is returned and errno is set to indicate the error.
+     */
+    virtual int     seek(int64_t offset, int whence);
+    /**
+     * @brief Check if at end of file.
+     * @return Returns true if at end of file.
+     */
+    virtual bool    eof() const;
+    /**
+     * @brief Stop the fetch threads and close all connections.
+     */
+    virtual void    close();
+
+protected:
+    /**
+     * @brief Open a connection to the remote file.
+     * @param[out] ctx - I/O context of the connection.
+     * @return Returns 0 on success, or an FFmpeg error code.
+     */
+    int                         connect(AVIOContext **ctx);
+    /**
+     * @brief Fetch thread: get blocks from the request queue, keeps its connection open.
+     * @param[in] ctx - Connection to use, or nullptr to open one on the first request.
+     */
+    void                        fetch_thread(AVIOContext *ctx);
+    /**
+     * @brief Queue a block and the blocks following it for fetching. m_mutex must be locked.
+     * @param[in] block_no - Block number that is read now.
+     */
+    void                        request(size_t block_no);
+    /**
+     * @brief Remove least recently used blocks if the cache is full. m_mutex must be locked.
+     * @param[in] block_no - Block number that is read now, this and the following blocks are kept.
+     */
+    void                        evict(size_t block_no);
+    /**
+     * @brief Check if the fetch threads are to be stopped.
+     * @param[in] opaque - Pointer to this object.
+     * @return Returns 1 to abort a pending request, 0 to continue.
+     */
+    static int                  interrupt_cb(void *opaque);
+
+protected:
+    std::string                 m_url;                          /**< @brief URL of remote file */
+    size_t                      m_size;                         /**< @brief Size of remote file */
+    size_t                      m_pos;                          /**< @brief Current read position */
+    bool                        m_eof;                          /**< @brief True if the last read hit the end of file */
+    int                         m_error;                        /**< @brief errno value of last read error, 0 if none */
+    unsigned int                m_connections;                  /**< @brief Number of parallel connections */
+    size_t                      m_cache_blocks;                 /**< @brief Max. number of blocks kept in the cache */
+    std::vector<std::thread>    m_threads;                      /**< @brief Fetch threads, one per connection */
+    std::mutex                  m_mutex;                        /**< @brief Protects the block cache and the request queue */
+    std::condition_variable     m_cond;                         /**< @brief Signalled when blocks are requested or fetched, and on close */
+    std::map<size_t, BLOCK>     m_blocks;                       /**< @brief Block cache by block number, including blocks being fetched */
+    std::deque<size_t>          m_queue;                        /**< @brief Blocks to be fetched, in order of priority */
+    uint64_t                    m_access;                       /**< @brief Access counter, for cache eviction */
+    std::atomic_bool            m_stop;                         /**< @brief Set to stop the fetch threads */
+};
+
+#endif // REMOTEIO_H
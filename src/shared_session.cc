@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * On Debian systems, the complete text of the GNU General Public License
+ * Version 3 can be found in `/usr/share/common-licenses/GPL-3'.
+ */
+
+/**
+ * @file
+ * @brief Shared transcoder session implementation
+ *
+ * @ingroup ffmpegfs
+ *
+ * @author Norbert Schlia (nschlia@oblivion-software.de)
+ * @copyright Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ */
+
+#include "shared_session.h"
+#include "ffmpegfs.h"
+#include "logging.h"
+
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/shm.h>        /* shmat(), IPC_RMID        */
+#include <semaphore.h>      /* sem_open(), sem_destroy(), sem_wait().. */
+
+#define SEM_OPEN_FILE       "/" PACKAGE_NAME "_2f5c0a3e-8d1b-4f67-9a42-6c3e1d7b9f05"    /**< @brief Shared semaphore name, should be unique system wide. */
+#define SHARED_SESSIONS     64                                                          /**< @brief Max. number of jobs in the table */
+#define SHARED_PROFILE_MAX  128                                                         /**< @brief Max. length of the output profile, including the terminating zero */
+
+/**
+ * @brief Job states
+ */
+typedef enum SESSIONSTATE
+{
+    SESSIONSTATE_FREE,              /**< @brief Slot is unused */
+    SESSIONSTATE_RUNNING,           /**< @brief Owner is transcoding */
+    SESSIONSTATE_FINISHED,          /**< @brief Owner completed the transcode, result can be read */
+    SESSIONSTATE_ABORTED            /**< @brief Owner stopped before completing the transcode */
+} SESSIONSTATE;
+
+/**
+ * @brief Job table entry, located in shared memory
+ */
+typedef struct SHARED_SESSION
+{
+    pid_t           m_pid;                      /**< @brief PID of owner process */
+    SESSIONSTATE    m_state;                    /**< @brief Job state */
+    size_t          m_watermark;                /**< @brief Bytes available in cache file */
+    time_t          m_reader_access;            /**< @brief Last time a process attached to the job has read from it, 0 if never */
+    char            m_desttype[11];             /**< @brief Destination type */
+    char            m_profile[SHARED_PROFILE_MAX];  /**< @brief Output options that change the result */
+    char            m_filename[PATH_MAX];       /**< @brief Source file name */
+    char            m_cachefile[PATH_MAX];      /**< @brief Cache file written by owner */
+} SHARED_SESSION;
+
+static sem_t *          sem = SEM_FAILED;       /**< @brief Semaphore used to synchronise access to the table */
+static int              shmid = -1;             /**< @brief Shared memory segment ID */
+static SHARED_SESSION * sessions = nullptr;     /**< @brief Job table in shared memory */
+
+static bool is_running(const SHARED_SESSION & session);
+static bool is_match(const SHARED_SESSION & session, const std::string & filename, const std::string & desttype, const std::string & profile);
+
+/**
+ * @brief Check if the owner of a job is still transcoding.
+ * @param[in] session - Table entry to check.
+ * @return Returns true if the job is running and the owner process exists.
+ */
+static bool is_running(const SHARED_SESSION & session)
+{
+    return (session.m_state == SESSIONSTATE_RUNNING && getpgid(session.m_pid) >= 0);
+}
+
+/**
+ * @brief Check if a table entry describes a job.
+ * @param[in] session - Table entry to check.
+ * @param[in] filename - Source file name.
+ * @param[in] desttype - Destination type.
+ * @param[in] profile - Output profile.
+ * @return Returns true if file name, destination type and output profile match.
+ */
+static bool is_match(const SHARED_SESSION & session, const std::string & filename, const std::string & desttype, const std::string & profile)
+{
+    return (session.m_state != SESSIONSTATE_FREE && filename == session.m_filename && desttype == session.m_desttype && profile == session.m_profile);
+}
+
+bool start_shared_sessions()
+{
+    key_t shmkey;
+
+    Logging::debug(nullptr, "Activating shared transcoder sessions.");
+
+    shmkey = ftok ("/dev/null", 6);     // valid directory name and a number, other than cache maintenance
+    if (shmkey == -1)
+    {
+        Logging::error(nullptr, "start_shared_sessions(): ftok error (%1) %2", errno, strerror(errno));
+        return false;
+    }
+
+    // Open existing memory or create it. Newly created memory is zeroed, i.e. all slots are free.
+    shmid = shmget (shmkey, sizeof(SHARED_SESSION) * SHARED_SESSIONS, IPC_CREAT | S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (shmid == -1)
+    {
+        Logging::error(nullptr, "start_shared_sessions(): shmget error (%1) %2", errno, strerror(errno));
+        return false;
+    }
+
+    void *p = shmat (shmid, nullptr, 0);
+    if (p == reinterpret_cast<void *>(-1))
+    {
+        Logging::error(nullptr, "start_shared_sessions(): shmat error (%1) %2", errno, strerror(errno));
+        shmid = -1;
+        return false;
+    }
+
+    sessions = static_cast<SHARED_SESSION *>(p);
+
+    // First try to open existing semaphore.
+    sem = sem_open(SEM_OPEN_FILE, 0, 0, 0);
+    if (sem == SEM_FAILED)
+    {
+        if (errno == ENOENT)
+        {
+            // If semaphore does not exist, then try to create one.
+            sem = sem_open(const_cast<const char *>(SEM_OPEN_FILE), O_CREAT | O_EXCL, 0777, 1);
+        }
+
+        if (sem == SEM_FAILED)
+        {
+            Logging::error(nullptr, "start_shared_sessions(): sem_open error (%1) %2", errno, strerror(errno));
+            stop_shared_sessions();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool stop_shared_sessions()
+{
+    struct shmid_ds buf;
+    bool success = true;
+
+    if (sessions == nullptr)
+    {
+        return true;
+    }
+
+    Logging::info(nullptr, "Shutting shared transcoder sessions down.");
+
+    if (sem != SEM_FAILED)
+    {
+        // Orphaned jobs would otherwise be detected by their PID, but be nice.
+        sem_wait(sem);
+        for (int slot = 0; slot < SHARED_SESSIONS; slot++)
+        {
+            if (sessions[slot].m_pid == getpid() && sessions[slot].m_state == SESSIONSTATE_RUNNING)
+            {
+                sessions[slot].m_state = SESSIONSTATE_ABORTED;
+            }
+        }
+        sem_post(sem);
+
+        if (sem_close(sem))
+        {
+            Logging::error(nullptr, "stop_shared_sessions(): sem_close error (%1) %2", errno, strerror(errno));
+            success = false;
+        }
+        sem = SEM_FAILED;
+    }
+
+    // shared memory detach
+    if (shmdt (sessions))
+    {
+        Logging::error(nullptr, "stop_shared_sessions(): shmdt error (%1) %2", errno, strerror(errno));
+        success = false;
+    }
+    sessions = nullptr;
+
+    if (shmctl(shmid, IPC_STAT, &buf))
+    {
+        Logging::error(nullptr, "stop_shared_sessions(): shmctl error (%1) %2", errno, strerror(errno));
+        success = false;
+    }
+    else if (!buf.shm_nattch)
+    {
+        if (shmctl (shmid, IPC_RMID, nullptr))
+        {
+            Logging::error(nullptr, "stop_shared_sessions(): shmctl error (%1) %2", errno, strerror(errno));
+            success = false;
+        }
+
+        // unlink prevents the semaphore existing forever
+        // if a crash occurs during the execution
+        if (sem_unlink(SEM_OPEN_FILE) && errno != ENOENT)
+        {
+            Logging::error(nullptr, "stop_shared_sessions(): sem_unlink error (%1) %2", errno, strerror(errno));
+            success = false;
+        }
+    }
+    shmid = -1;
+
+    return success;
+}
+
+int shared_session_acquire(const std::string & filename, const std::string & desttype, const std::string & profile, const std::string & cachefile, bool *owner)
+{
+    int slot = -1;
+    int free_slot = -1;
+
+    *owner = true;
+
+    if (sessions == nullptr || filename.size() >= PATH_MAX || cachefile.size() >= PATH_MAX || profile.size() >= SHARED_PROFILE_MAX)
+    {
+        return -1;
+    }
+
+    sem_wait(sem);
+
+    for (int n = 0; n < SHARED_SESSIONS; n++)
+    {
+        if (is_running(sessions[n]))
+        {
+            if (is_match(sessions[n], filename, desttype, profile))
+            {
+                slot = n;
+                *owner = (sessions[n].m_pid == getpid());
+                break;
+            }
+        }
+        else if (free_slot == -1)
+        {
+            // Free, finished, aborted or owner gone: can be reused
+            free_slot = n;
+        }
+    }
+
+    if (slot == -1 && free_slot != -1)
+    {
+        SHARED_SESSION * session = &sessions[free_slot];
+
+        session->m_pid          = getpid();
+        session->m_state        = SESSIONSTATE_RUNNING;
+        session->m_watermark    = 0;
+        session->m_reader_access = 0;
+        session->m_desttype[0]  = '\0';
+        strncat(session->m_desttype, desttype.c_str(), sizeof(session->m_desttype) - 1);
+        session->m_profile[0]   = '\0';
+        strncat(session->m_profile, profile.c_str(), sizeof(session->m_profile) - 1);
+        session->m_filename[0]  = '\0';
+        strncat(session->m_filename, filename.c_str(), sizeof(session->m_filename) - 1);
+        session->m_cachefile[0] = '\0';
+        strncat(session->m_cachefile, cachefile.c_str(), sizeof(session->m_cachefile) - 1);
+
+        slot = free_slot;
+    }
+
+    sem_post(sem);
+
+    if (slot == -1)
+    {
+        Logging::warning(filename, "Shared session table is full, transcoding without sharing.");
+    }
+    else if (!*owner)
+    {
+        Logging::info(filename, "Transcoding is already running in process with PID %1, attaching to it.", sessions[slot].m_pid);
+    }
+
+    return slot;
+}
+
+time_t shared_session_update(int slot, size_t watermark)
+{
+    time_t reader_access;
+
+    if (sessions == nullptr || slot < 0)
+    {
+        return 0;
+    }
+
+    sem_wait(sem);
+    sessions[slot].m_watermark  = watermark;
+    reader_access               = sessions[slot].m_reader_access;
+    sem_post(sem);
+
+    return reader_access;
+}
+
+void shared_session_release(int slot, size_t watermark, bool finished)
+{
+    if (sessions == nullptr || slot < 0)
+    {
+        return;
+    }
+
+    sem_wait(sem);
+    sessions[slot].m_watermark  = watermark;
+    sessions[slot].m_state      = finished ? SESSIONSTATE_FINISHED : SESSIONSTATE_ABORTED;
+    sem_post(sem);
+}
+
+bool shared_session_state(int slot, const std::string & filename, const std::string & desttype, const std::string & profile, std::string * cachefile, size_t *watermark, bool *finished)
+{
+    bool success = false;
+
+    if (sessions == nullptr || slot < 0)
+    {
+        return false;
+    }
+
+    sem_wait(sem);
+
+    const SHARED_SESSION & session = sessions[slot];
+
+    if (is_match(session, filename, desttype, profile) && (session.m_state == SESSIONSTATE_FINISHED || is_running(session)))
+    {
+        *cachefile  = session.m_cachefile;
+        *watermark  = session.m_watermark;
+        *finished   = (session.m_state == SESSIONSTATE_FINISHED);
+        success     = true;
+
+        // Keeps the owner from suspending while only we are reading
+        sessions[slot].m_reader_access = time(nullptr);
+    }
+
+    sem_post(sem);
+
+    return success;
+}
+
+std::string shared_session_profile()
+{
+    // All options that select codecs, bit rates, sizes or filters
+    return string_format("ab=%" PRId64 ",ar=%d,ac=%d,vb=%" PRId64 ",s=%dx%d,di=%d,ca=%d,rs=%d,p=%d,l=%d,na=%d",
+                         static_cast<int64_t>(params.m_audiobitrate),
+                         params.m_audiosamplerate,
+                         params.m_audiochannels,
+                         static_cast<int64_t>(params.m_videobitrate),
+                         params.m_videowidth,
+                         params.m_videoheight,
+                         params.m_deinterlace,
+                         static_cast<int>(params.m_autocopy),
+                         static_cast<int>(params.m_recodesame),
+                         static_cast<int>(params.m_profile),
+                         static_cast<int>(params.m_level),
+                         params.m_noalbumarts);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * On Debian systems, the complete text of the GNU General Public License
+ * Version 3 can be found in `/usr/share/common-licenses/GPL-3'.
+ */
+
+/**
+ * @file
+ * @brief Transcoder sessions shared between FFmpegfs processes
+ *
+ * Keeps a table of running transcodes in a shared memory area, protected
+ * by a named semaphore, just like the cache maintenance does to elect its
+ * master process.
+ *
+ * If several FFmpegfs processes use the same cache, only the first one
+ * to open a file transcodes it. The others find the running job in the
+ * table and read the result from the cache file of the owning process,
+ * up to the watermark that the owner publishes. Readers record the time
+ * of their last access, so that the owner does not suspend or abort the
+ * transcode while only other processes are reading it.
+ *
+ * Jobs are matched by source file, destination type and the output
+ * profile, i.e. the options that change the result. Mounts with
+ * different bit rates or sizes never share a transcode.
+ *
+ * @ingroup ffmpegfs
+ *
+ * @author Norbert Schlia (nschlia@oblivion-software.de)
+ * @copyright Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ */
+
+#ifndef SHARED_SESSION_H
+#define SHARED_SESSION_H
+
+#pragma once
+
+#include <string>
+#include <time.h>
+
+/**
+ * @brief Create or attach the shared session table.
+ * @return On success, returns true. On error, returns false. Check errno for details.
+ */
+bool start_shared_sessions();
+/**
+ * @brief Detach the shared session table, remove it if this was the last process.
+ * @return On success, returns true. On error, returns false. Check errno for details.
+ */
+bool stop_shared_sessions();
+/**
+ * @brief Register a transcode, or find the process that already runs it.
+ * @param[in] filename - Source file name.
+ * @param[in] desttype - Destination type, e.g. "mp4".
+ * @param[in] profile - Output options that change the result, see shared_session_profile().
+ * @param[in] cachefile - Cache file the transcoder writes to.
+ * @param[out] owner - Set to true if this process owns the job and must transcode, false if another process runs it.
+ * @return Returns the table slot of the job, or -1 if the table is not available or full. In that case transcode as usual.
+ */
+int shared_session_acquire(const std::string & filename, const std::string & desttype, const std::string & profile, const std::string & cachefile, bool *owner);
+/**
+ * @brief Publish the progress of an owned job.
+ * @param[in] slot - Table slot returned by shared_session_acquire().
+ * @param[in] watermark - Number of bytes available in the cache file.
+ * @return Returns the last time another process has read from the job, 0 if none has.
+ */
+time_t shared_session_update(int slot, size_t watermark);
+/**
+ * @brief Remove an owned job from the table.
+ * @param[in] slot - Table slot returned by shared_session_acquire().
+ * @param[in] watermark - Final number of bytes available in the cache file.
+ * @param[in] finished - True if the transcode completed successfully, false if it was aborted.
+ */
+void shared_session_release(int slot, size_t watermark, bool finished);
+/**
+ * @brief Get the state of a job owned by another process, and record that it is being read.
+ * @param[in] slot - Table slot returned by shared_session_acquire().
+ * @param[in] filename - Source file name, to detect a slot that has been reused.
+ * @param[in] desttype - Destination type, to detect a slot that has been reused.
+ * @param[in] profile - Output profile, to detect a slot that has been reused.
+ * @param[out] cachefile - Cache file of the owner.
+ * @param[out] watermark - Number of bytes available in the cache file.
+ * @param[out] finished - Set to true if the owner completed the job.
+ * @return Returns true if the job is running or finished, false if the owner has gone away or failed.
+ */
+bool shared_session_state(int slot, const std::string & filename, const std::string & desttype, const std::string & profile, std::string * cachefile, size_t *watermark, bool *finished);
+/**
+ * @brief Get the output options of this process that change the transcoded result.
+ * @return Returns the options as a string, equal for processes with the same settings.
+ */
+std::string shared_session_profile();
+
+#endif // SHARED_SESSION_H
@@ -33,12 +33,20 @@
 #include "logging.h"
 #include "config.h"
 
+#include <dirent.h>
+#include <string.h>
+#include <pthread.h>
+
 thread_pool::thread_pool(unsigned int num_threads)
     : m_queue_shutdown(false)
     , m_num_threads(num_threads)
     , m_cur_threads(0)
-
+    , m_threads_running(0)
+    , m_max_busy(0)
+    , m_busy(0)
+    , m_resuming(0)
 {
+    CPU_ZERO(&m_all_cpus);
 }
 
 thread_pool::~thread_pool()
@@ -60,9 +68,10 @@ void thread_pool::loop_function()
     while (true)
     {
         THREADINFO info;
+        int node = -1;
         {
             std::unique_lock<std::mutex> lock(m_queue_mutex);
-            m_queue_condition.wait(lock, [this]{ return (!m_thread_queue.empty() || m_queue_shutdown); });
+            m_queue_condition.wait(lock, [this]{ return ((!m_thread_queue.empty() && (!m_max_busy || (m_busy < m_max_busy && !m_resuming))) || m_queue_shutdown); });
 
             if (m_queue_shutdown)
             {
@@ -70,35 +79,206 @@ void thread_pool::loop_function()
                 break;
             }
 
-            Logging::trace(nullptr, "Starting job using pool thread no. %1 with id 0x%<%" FFMPEGFS_FORMAT_PTHREAD_T ">2.", thread_no, pthread_self());
             info = m_thread_queue.front();
             m_thread_queue.pop();
+
+            m_threads_running++;
+            m_busy++;
+
+            node = next_numa_node();
+            if (node != -1)
+            {
+                m_numa_running[static_cast<size_t>(node)]++;
+            }
         }
 
+        if (node != -1)
+        {
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &m_numa_cpus[static_cast<size_t>(node)]);
+        }
+
+        // Log outside the critical section, keep the time the queue is locked short
+        Logging::trace(nullptr, "Starting job using pool thread no. %1 with id 0x%<%" FFMPEGFS_FORMAT_PTHREAD_T ">2.", thread_no, pthread_self());
+
         info.m_thread_func(info.m_opaque);
+
+        if (node != -1)
+        {
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &m_all_cpus);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+
+            m_threads_running--;
+            m_busy--;
+
+            if (node != -1)
+            {
+                m_numa_running[static_cast<size_t>(node)]--;
+            }
+        }
+
+        // A slot is free, let the next queued job start
+        m_queue_condition.notify_all();
     }
 
     Logging::trace(nullptr, "Exiting pool thread no. %1 with id 0x%<%" FFMPEGFS_FORMAT_PTHREAD_T ">2.", thread_no, pthread_self());
 }
 
+int thread_pool::next_numa_node() const
+{
+    int best_node = -1;
+
+    for (size_t node = 0; node < m_numa_running.size(); node++)
+    {
+        if (best_node == -1 || m_numa_running[node] < m_numa_running[static_cast<size_t>(best_node)])
+        {
+            best_node = static_cast<int>(node);
+        }
+    }
+
+    return best_node;
+}
+
+bool thread_pool::parse_cpulist(const std::string & cpulist, cpu_set_t *cpus)
+{
+    const char *p = cpulist.c_str();
+    bool found = false;
+
+    CPU_ZERO(cpus);
+
+    while (*p)
+    {
+        char *end;
+        unsigned long first = strtoul(p, &end, 10);
+        unsigned long last = first;
+
+        if (end == p)
+        {
+            break;
+        }
+
+        p = end;
+        if (*p == '-')
+        {
+            last = strtoul(p + 1, &end, 10);
+            p = end;
+        }
+
+        for (unsigned long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+        {
+            CPU_SET(cpu, cpus);
+            found = true;
+        }
+
+        if (*p == ',')
+        {
+            p++;
+        }
+    }
+
+    return found;
+}
+
+bool thread_pool::enable_numa()
+{
+    std::vector<cpu_set_t> numa_cpus;
+    DIR *dir = opendir("/sys/devices/system/node");
+
+    if (dir == nullptr)
+    {
+        Logging::warning(nullptr, "NUMA placement not available: (%1) %2", errno, strerror(errno));
+        return false;
+    }
+
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &m_all_cpus) == -1)
+    {
+        Logging::warning(nullptr, "NUMA placement not available: (%1) %2", errno, strerror(errno));
+        closedir(dir);
+        return false;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        unsigned int node_no;
+        char tail;
+
+        if (sscanf(entry->d_name, "node%u%c", &node_no, &tail) != 1)
+        {
+            continue;
+        }
+
+        std::string filename("/sys/devices/system/node/");
+        filename += entry->d_name;
+        filename += "/cpulist";
+
+        FILE *fp = fopen(filename.c_str(), "r");
+        if (fp == nullptr)
+        {
+            continue;
+        }
+
+        char cpulist[1024] = "";
+        if (fgets(cpulist, sizeof(cpulist), fp) != nullptr)
+        {
+            cpu_set_t cpus;
+
+            // Only CPUs this process may run on, memory only nodes are skipped.
+            if (parse_cpulist(cpulist, &cpus))
+            {
+                CPU_AND(&cpus, &cpus, &m_all_cpus);
+                if (CPU_COUNT(&cpus))
+                {
+                    numa_cpus.push_back(cpus);
+                }
+            }
+        }
+        fclose(fp);
+    }
+
+    closedir(dir);
+
+    if (numa_cpus.size() < 2)
+    {
+        Logging::info(nullptr, "Found %1 NUMA node(s), NUMA placement not required.", numa_cpus.size());
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+
+        m_numa_cpus = numa_cpus;
+        m_numa_running.assign(m_numa_cpus.size(), 0);
+    }
+
+    Logging::info(nullptr, "Spreading jobs over %1 NUMA nodes.", m_numa_cpus.size());
+
+    return true;
+}
+
 bool thread_pool::schedule_thread(void (*thread_func)(void *), void *opaque)
 {
     if (!m_queue_shutdown)
     {
-        Logging::trace(nullptr, "Queueing new thread. %1 threads already in queue.", m_thread_pool.size());
+        THREADINFO info;
+        size_t queue_size;
+
+        info.m_thread_func  = thread_func;
+        info.m_opaque       = opaque;
 
         {
             std::lock_guard<std::mutex> lock(m_queue_mutex);
 
-            THREADINFO info;
-
-            info.m_thread_func  = thread_func;
-            info.m_opaque       = opaque;
+            queue_size = m_thread_queue.size();
             m_thread_queue.push(info);
         }
 
         m_queue_condition.notify_one();
 
+        Logging::trace(nullptr, "Queued new thread. %1 threads already in queue.", queue_size);
+
         return true;
     }
     else
@@ -107,8 +287,44 @@ bool thread_pool::schedule_thread(void (*thread_func)(void *), void *opaque)
     }
 }
 
-unsigned int thread_pool::current_running() const
+void thread_pool::set_max_busy(unsigned int max_busy)
 {
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+
+        m_max_busy = max_busy;
+    }
+
+    m_queue_condition.notify_all();
+}
+
+void thread_pool::job_idle()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+
+        m_busy--;
+    }
+
+    m_queue_condition.notify_all();
+}
+
+void thread_pool::job_busy()
+{
+    std::unique_lock<std::mutex> lock(m_queue_mutex);
+
+    // A job that already ran goes before queued jobs
+    m_resuming++;
+    m_queue_condition.wait(lock, [this]{ return (!m_max_busy || m_busy < m_max_busy || m_queue_shutdown); });
+    m_resuming--;
+
+    m_busy++;
+}
+
+unsigned int thread_pool::current_running()
+{
+    std::lock_guard<std::mutex> lock(m_queue_mutex);
+
     return m_threads_running;
 }
 
@@ -143,7 +359,7 @@ void thread_pool::tear_down(bool silent)
 {
     if (!silent)
     {
-        Logging::debug(nullptr, "Tearing down thread pool. %1 threads still in queue.", m_thread_queue.size());
+        Logging::debug(nullptr, "Tearing down thread pool. %1 threads still in queue.", current_queued());
     }
 
     m_queue_mutex.lock();
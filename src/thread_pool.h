@@ -29,12 +29,14 @@
 #include <mutex>
 #include <condition_variable>
 #include <unistd.h>
+#include <sched.h>
 
 /**
  * @brief The thread_pool class.
  */
 class thread_pool
 {
+protected:
     typedef struct THREADINFO                       /**< Thread info structure */
     {
         void (*m_thread_func)(void *);              /**< Job function pointer */
@@ -69,11 +71,41 @@ public:
      * @return Returns true if thread was successfully scheduled, fals if not.
      */
     bool            schedule_thread(void (*thread_func)(void *), void *opaque);
+    /**
+     * @brief Run each job on the CPUs of one NUMA node.
+     *
+     * Jobs are spread over the nodes, each goes to the node with the fewest running jobs.
+     * Threads the job creates, e.g. by codecs, inherit the node, and memory the job
+     * touches first is allocated there.
+     *
+     * @return Returns true if enabled, false if the machine has less than two nodes.
+     */
+    bool            enable_numa();
+    /**
+     * @brief Limit the number of jobs that may be busy at the same time.
+     *
+     * The pool may have more threads than CPU cores, e.g. for jobs that wait for a reader.
+     * Busy jobs beyond the limit only compete for the CPUs, further jobs are kept in the
+     * queue until a busy job finishes or goes idle.
+     *
+     * @param[in] max_busy - Max. number of busy jobs, 0 for no limit.
+     */
+    void            set_max_busy(unsigned int max_busy);
+    /**
+     * @brief Called by a running job before it waits for a longer time, e.g. for a reader.
+     * Gives its slot to the next queued job.
+     */
+    void            job_idle();
+    /**
+     * @brief Called by a running job when it continues after job_idle().
+     * Waits until a slot is free.
+     */
+    void            job_busy();
     /**
      * @brief Get number of currently running threads.
      * @return Returns number of currently running threads.
      */
-    unsigned int    current_running() const;
+    unsigned int    current_running();
     /**
      * @brief Get number of currently queued threads.
      * @return Returns number of currently queued threads.
@@ -95,6 +127,18 @@ private:
      * @brief Start loop function
      */
     void            loop_function();
+    /**
+     * @brief Find the NUMA node with the fewest running jobs. Must be called with m_queue_mutex held.
+     * @return Returns the node index into m_numa_cpus, or -1 if NUMA placement is disabled.
+     */
+    int             next_numa_node() const;
+    /**
+     * @brief Parse a CPU list as found in /sys/devices/system/node/nodeN/cpulist, e.g. "0-7,16-23".
+     * @param[in] cpulist - CPU list.
+     * @param[out] cpus - CPU set to fill.
+     * @return Returns true if at least one CPU was found, false if not.
+     */
+    static bool     parse_cpulist(const std::string & cpulist, cpu_set_t *cpus);
 
 protected:
     std::vector<std::thread>    m_thread_pool;      /**< Thread pool */
@@ -104,7 +148,13 @@ protected:
     volatile bool               m_queue_shutdown;   /**< If true all threads have been shut down */
     unsigned int                m_num_threads;      /**< Max. number of threads. Defaults to 4x number of CPU cores. */
     unsigned int                m_cur_threads;      /**< Current number of threads. */
-    volatile unsigned int       m_threads_running;  /**< Currently running threads. */
+    unsigned int                m_threads_running;  /**< Currently running threads, protected by m_queue_mutex */
+    unsigned int                m_max_busy;         /**< Max. number of busy jobs, 0 for no limit */
+    unsigned int                m_busy;             /**< Currently busy jobs, i.e. running and not idle, protected by m_queue_mutex */
+    unsigned int                m_resuming;         /**< Jobs waiting in job_busy() for a slot, they go before queued jobs. Protected by m_queue_mutex */
+    std::vector<cpu_set_t>      m_numa_cpus;        /**< CPUs of each NUMA node, empty if NUMA placement is disabled */
+    std::vector<unsigned int>   m_numa_running;     /**< Currently running jobs per NUMA node */
+    cpu_set_t                   m_all_cpus;         /**< CPUs the process may use, restored after a job */
 };
 
 #endif // THREAD_POOL_H
@@ -41,9 +41,16 @@
 #include "logging.h"
 #include "cache_entry.h"
 #include "thread_pool.h"
+#include "shared_session.h"
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <atomic>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
 
 /** @brief 1 millisecond = 1,000,000 Nanoseconds */
 #define MS  *1000000L
@@ -62,11 +69,472 @@ typedef struct THREAD_DATA
 
 static Cache *cache;                            /**< @brief Global cache manager object */
 static volatile bool thread_exit;               /**< @brief Used for shutdown: if true, exit all thread */
+static volatile bool thread_drain;              /**< @brief Used for shutdown: if true, stop transcoders at the next safe point */
+static std::atomic_int running_transcoders(0);  /**< @brief Number of transcoder jobs queued or running */
+
+/**
+ * @brief Encode speed measurement of a transcoder
+ */
+typedef struct ADMISSION
+{
+    std::chrono::steady_clock::time_point m_last_time;  /**< @brief Time of last measurement */
+    int64_t                 m_last_pos;                 /**< @brief Output position at last measurement, in AV_TIME_BASE units */
+    unsigned int            m_speed;                    /**< @brief Smoothed encode speed in percent of real time, 0 until first measured */
+} ADMISSION;
+
+static std::mutex admission_mutex;              /**< @brief Access mutex for admission_speed */
+static std::map<const Cache_Entry *, ADMISSION> admission_speed; /**< @brief Encode speed of transcoders with active readers */
+
+/**
+ * @brief Memory used by a transcoder
+ */
+typedef struct MEMORY_USAGE
+{
+    size_t                  m_usage;                    /**< @brief Estimated memory of the transcoder, in bytes */
+    bool                    m_reader;                   /**< @brief True if a reader is attached */
+    time_t                  m_last_check;               /**< @brief Time of last check */
+    bool                    m_selected;                 /**< @brief Result of last check: transcoder must give way */
+} MEMORY_USAGE;
+
+static std::mutex memory_mutex;                 /**< @brief Access mutex for memory_usage */
+static std::map<const Cache_Entry *, MEMORY_USAGE> memory_usage; /**< @brief Memory used by running transcoders */
 
 static void transcoder_thread(void *arg);
+static void admission_update(const Cache_Entry *cache_entry, FFmpeg_Transcoder *transcoder, bool remove);
+static bool admission_ok();
+static void admission_wait(Cache_Entry *cache_entry);
+static bool memory_exceeded();
+static bool memory_check(const Cache_Entry *cache_entry, const FFmpeg_Transcoder *transcoder);
+static bool memory_select(const Cache_Entry *cache_entry, size_t excess);
+static void memory_report(size_t anonymous);
+static void memory_remove(const Cache_Entry *cache_entry);
+static bool shared_attach(Cache_Entry *cache_entry);
+static void shared_update(Cache_Entry *cache_entry);
+static bool transcoder_read_shared(Cache_Entry* cache_entry, char* buff, size_t offset, size_t len, int * bytes_read);
 static bool transcode_until(Cache_Entry* cache_entry, size_t offset, size_t len, uint32_t segment_no);
 static int transcode_finish(Cache_Entry* cache_entry, FFmpeg_Transcoder *transcoder);
 
+/**
+ * @brief Track the encode speed of a transcoder.
+ * Only transcoders with readers attached are taken into account, no one is waiting for the others.
+ * @param[in] cache_entry - Corresponding cache entry.
+ * @param[in] transcoder - Transcoder object.
+ * @param[in] remove - If true, transcoding has ended and the transcoder is removed from the list.
+ */
+static void admission_update(const Cache_Entry *cache_entry, FFmpeg_Transcoder *transcoder, bool remove)
+{
+    if (!params.m_min_encode_speed)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(admission_mutex);
+
+    if (remove || cache_entry->ref_count() <= 1)
+    {
+        admission_speed.erase(cache_entry);
+        return;
+    }
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    int64_t pos = transcoder->output_pos();
+
+    std::map<const Cache_Entry *, ADMISSION>::iterator it = admission_speed.find(cache_entry);
+    if (it == admission_speed.end() || pos < it->second.m_last_pos)
+    {
+        // Started or seeked backwards, begin new measurement
+        ADMISSION & admission = admission_speed[cache_entry];
+
+        admission.m_last_pos    = pos;
+        admission.m_last_time   = now;
+        return;
+    }
+
+    ADMISSION & admission = it->second;
+
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - admission.m_last_time).count();
+
+    if (elapsed < AV_TIME_BASE)
+    {
+        // Measure over at least one second
+        return;
+    }
+
+    unsigned int speed = static_cast<unsigned int>((pos - admission.m_last_pos) * 100 / elapsed);
+
+    admission.m_last_pos    = pos;
+    admission.m_last_time   = now;
+
+    // Smooth out short peaks
+    admission.m_speed = admission.m_speed ? (admission.m_speed * 3 + speed) / 4 : std::max(speed, 1u);
+}
+
+/**
+ * @brief Check if there is enough CPU and memory left to start another transcoder.
+ * @return Returns true if the transcoders with readers run on average at least at params.m_min_encode_speed
+ * and the memory ceiling has not been reached, false if not.
+ */
+static bool admission_ok()
+{
+    if (memory_exceeded())
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(admission_mutex);
+
+    uint64_t total = 0;
+    unsigned int count = 0;
+
+    for (std::map<const Cache_Entry *, ADMISSION>::const_iterator it = admission_speed.cbegin(); it != admission_speed.cend(); ++it)
+    {
+        if (it->second.m_speed)
+        {
+            total += it->second.m_speed;
+            count++;
+        }
+    }
+
+    return (!count || total / count >= params.m_min_encode_speed);
+}
+
+/**
+ * @brief Wait until the CPU and memory budget allows to start another transcoder.
+ * Gives up after params.m_max_inactive_abort seconds and lets the transcoder start anyway.
+ * The cache entry must not be locked while waiting.
+ * @param[in] cache_entry - Corresponding cache entry.
+ */
+static void admission_wait(Cache_Entry *cache_entry)
+{
+    if (admission_ok())
+    {
+        return;
+    }
+
+    Logging::info(cache_entry->destname(), "Running transcoders are too slow or memory limit is reached, queueing transcoder.");
+
+    time_t start = time(nullptr);
+
+    do
+    {
+        if (time(nullptr) - start >= params.m_max_inactive_abort)
+        {
+            Logging::warning(cache_entry->destname(), "Resources still busy after %1 seconds, starting transcoder anyway.", params.m_max_inactive_abort);
+            return;
+        }
+
+        sleep(1);
+    }
+    while (!admission_ok() && !thread_exit && !thread_drain);
+
+    Logging::debug(cache_entry->destname(), "Transcoder admitted after %1 seconds.", time(nullptr) - start);
+}
+
+/**
+ * @brief Check if the memory ceiling has been reached.
+ * @return Returns true if the anonymous memory exceeds params.m_max_memory, false if not or if there is no limit.
+ */
+static bool memory_exceeded()
+{
+    return (params.m_max_memory && get_anonymous_size() > params.m_max_memory);
+}
+
+/**
+ * @brief Check the memory ceiling from within a transcoder, at most once a second.
+ * Between checks, the result of the last check is returned.
+ * @param[in] cache_entry - Corresponding cache entry.
+ * @param[in] transcoder - Transcoder object.
+ * @return Returns true if the ceiling has been exceeded and this transcoder is one of the largest, which must give way.
+ */
+static bool memory_check(const Cache_Entry *cache_entry, const FFmpeg_Transcoder *transcoder)
+{
+    if (!params.m_max_memory)
+    {
+        return false;
+    }
+
+    time_t now = time(nullptr);
+
+    {
+        std::lock_guard<std::mutex> lock(memory_mutex);
+
+        MEMORY_USAGE & usage = memory_usage[cache_entry];
+
+        usage.m_usage   = transcoder->memory_usage();
+        usage.m_reader  = (cache_entry->ref_count() > 1);
+
+        if (now == usage.m_last_check)
+        {
+            return usage.m_selected;
+        }
+
+        usage.m_last_check = now;
+    }
+
+    size_t anonymous = get_anonymous_size();
+    bool exceeded = (anonymous > params.m_max_memory);
+
+    std::lock_guard<std::mutex> lock(memory_mutex);
+
+    MEMORY_USAGE & usage = memory_usage[cache_entry];
+
+    usage.m_selected = exceeded && memory_select(cache_entry, anonymous - params.m_max_memory);
+
+    if (usage.m_selected)
+    {
+        memory_report(anonymous);
+    }
+
+    return usage.m_selected;
+}
+
+/**
+ * @brief Check if a transcoder is among the largest consumers that must give way. memory_mutex must be locked.
+ *
+ * Transcoders without readers are picked first, then those with readers, each largest first, until
+ * their memory covers the excess.
+ *
+ * @param[in] cache_entry - Corresponding cache entry.
+ * @param[in] excess - Bytes above the ceiling.
+ * @return Returns true if the transcoder has been picked.
+ */
+static bool memory_select(const Cache_Entry *cache_entry, size_t excess)
+{
+    std::vector<std::map<const Cache_Entry *, MEMORY_USAGE>::const_iterator> order;
+
+    for (std::map<const Cache_Entry *, MEMORY_USAGE>::const_iterator it = memory_usage.cbegin(); it != memory_usage.cend(); ++it)
+    {
+        order.push_back(it);
+    }
+
+    std::sort(order.begin(), order.end(), [](std::map<const Cache_Entry *, MEMORY_USAGE>::const_iterator a, std::map<const Cache_Entry *, MEMORY_USAGE>::const_iterator b)
+    {
+        if (a->second.m_reader != b->second.m_reader)
+        {
+            return !a->second.m_reader;
+        }
+        return a->second.m_usage > b->second.m_usage;
+    });
+
+    size_t covered = 0;
+
+    for (std::map<const Cache_Entry *, MEMORY_USAGE>::const_iterator it : order)
+    {
+        if (it->first == cache_entry)
+        {
+            return true;
+        }
+
+        covered += it->second.m_usage;
+
+        if (covered >= excess)
+        {
+            break;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Log the memory used by each transcoder, at most every 10 seconds. memory_mutex must be locked.
+ * @param[in] anonymous - Anonymous memory of the process.
+ */
+static void memory_report(size_t anonymous)
+{
+    static time_t last_report = 0;
+
+    if (time(nullptr) - last_report < 10)
+    {
+        return;
+    }
+
+    last_report = time(nullptr);
+
+    Logging::info(nullptr, "Memory limit of %1 exceeded, anonymous memory is %2. %3 transcoder(s) running:", format_size(params.m_max_memory).c_str(), format_size(anonymous).c_str(), memory_usage.size());
+
+    for (std::map<const Cache_Entry *, MEMORY_USAGE>::const_iterator it = memory_usage.cbegin(); it != memory_usage.cend(); ++it)
+    {
+        Logging::info(it->first->destname(), "Transcoder uses %1%2%3.",
+                      format_size(it->second.m_usage).c_str(),
+                      it->second.m_reader ? ", reader attached" : "",
+                      it->second.m_selected ? ", giving way" : "");
+    }
+}
+
+/**
+ * @brief Remove a transcoder from the memory accounting.
+ * @param[in] cache_entry - Corresponding cache entry.
+ */
+static void memory_remove(const Cache_Entry *cache_entry)
+{
+    std::lock_guard<std::mutex> lock(memory_mutex);
+
+    memory_usage.erase(cache_entry);
+}
+
+/**
+ * @brief Look up the shared session table, register the transcode or attach to another process running it.
+ * @param[in] cache_entry - Corresponding cache entry.
+ * @return Returns true if another process transcodes the file, false if this process must do it.
+ */
+static bool shared_attach(Cache_Entry *cache_entry)
+{
+    if (!params.m_shared_sessions || (cache_entry->virtualfile()->m_flags & (VIRTUALFLAG_FRAME | VIRTUALFLAG_HLS)))
+    {
+        return false;
+    }
+
+    if (!cache_entry->m_shared_cachefile.empty())
+    {
+        // Result of another process from an earlier open, use it as long as it is still there.
+        struct stat sb;
+
+        if (!stat(cache_entry->m_shared_cachefile.c_str(), &sb) && static_cast<size_t>(sb.st_size) >= cache_entry->m_shared_size)
+        {
+            return true;
+        }
+
+        cache_entry->close_shared();
+        cache_entry->m_shared_cachefile.clear();
+        cache_entry->m_shared_size = 0;
+    }
+
+    bool owner = true;
+
+    cache_entry->m_shared_session   = shared_session_acquire(cache_entry->filename(), cache_entry->m_cache_info.m_desttype, shared_session_profile(), cache_entry->m_buffer->cachefile(0), &owner);
+    cache_entry->m_shared_owner     = owner;
+    cache_entry->m_shared_reader_access = 0;
+
+    return (cache_entry->m_shared_session != -1 && !owner);
+}
+
+/**
+ * @brief Publish the progress of a shared session this process runs, and fetch the last access of readers in other processes.
+ * @param[in] cache_entry - Corresponding cache entry.
+ */
+static void shared_update(Cache_Entry *cache_entry)
+{
+    if (cache_entry->m_shared_owner)
+    {
+        cache_entry->m_shared_reader_access = shared_session_update(cache_entry->m_shared_session, cache_entry->m_buffer->buffer_watermark());
+    }
+}
+
+/**
+ * @brief Read from the cache file of a transcode that runs in another process.
+ * Waits until the owner has written the requested range or has finished.
+ * @param[in] cache_entry - Corresponding cache entry.
+ * @param[in] buff - Data buffer to fill in.
+ * @param[in] offset - Offset in file.
+ * @param[in] len - Length of data chunk to be read.
+ * @param[out] bytes_read - Bytes read from the file.
+ * @return On success, returns true. Returns false if an error occurred, check errno for details.
+ */
+static bool transcoder_read_shared(Cache_Entry* cache_entry, char* buff, size_t offset, size_t len, int * bytes_read)
+{
+    std::string cachefile(cache_entry->m_shared_cachefile);
+    size_t watermark = cache_entry->m_shared_size;
+    bool finished = !cachefile.empty();
+    size_t last_watermark = 0;
+    time_t last_progress = time(nullptr);
+
+    *bytes_read = 0;
+
+    while (!finished)
+    {
+        if (!shared_session_state(cache_entry->m_shared_session, cache_entry->filename(), cache_entry->m_cache_info.m_desttype, shared_session_profile(), &cachefile, &watermark, &finished))
+        {
+            Logging::error(cache_entry->destname(), "Transcoder in other process has gone away.");
+            cache_entry->m_shared_session = -1;
+            cache_entry->close_shared();
+            errno = EIO;
+            return false;
+        }
+
+        if (finished)
+        {
+            // Remember the result, the table slot may be reused from now on.
+            cache_entry->m_shared_cachefile = cachefile;
+            cache_entry->m_shared_size      = watermark;
+            cache_entry->m_shared_session   = -1;
+            break;
+        }
+
+        if (watermark >= offset + len)
+        {
+            break;
+        }
+
+        if (fuse_interrupted())
+        {
+            Logging::info(cache_entry->destname(), "Client has gone away.");
+            errno = EIO;
+            return false;
+        }
+
+        if (thread_exit)
+        {
+            Logging::warning(cache_entry->destname(), "Received thread exit.");
+            errno = EIO;
+            return false;
+        }
+
+        if (watermark != last_watermark)
+        {
+            last_watermark  = watermark;
+            last_progress   = time(nullptr);
+        }
+        else if (time(nullptr) - last_progress > params.m_max_inactive_abort)
+        {
+            Logging::error(cache_entry->destname(), "Transcoder in other process made no progress for %1 seconds.", params.m_max_inactive_abort);
+            errno = EIO;
+            return false;
+        }
+
+        usleep(10000);
+    }
+
+    if (offset >= watermark)
+    {
+        errno = 0;
+        return true;
+    }
+
+    if (offset + len > watermark)
+    {
+        len = watermark - offset;
+    }
+
+    // Keep the file open for subsequent reads
+    if (cache_entry->m_shared_fd == -1)
+    {
+        cache_entry->m_shared_fd = ::open(cachefile.c_str(), O_RDONLY | O_CLOEXEC);
+        if (cache_entry->m_shared_fd == -1)
+        {
+            int _errno = errno;
+            Logging::error(cachefile, "Error opening shared cache file: (%1) %2", _errno, strerror(_errno));
+            errno = _errno;
+            return false;
+        }
+    }
+
+    ssize_t res = pread(cache_entry->m_shared_fd, buff, len, static_cast<off_t>(offset));
+
+    if (res < 0)
+    {
+        int _errno = errno;
+        Logging::error(cachefile, "Error reading shared cache file: (%1) %2", _errno, strerror(_errno));
+        errno = _errno;
+        return false;
+    }
+
+    *bytes_read = static_cast<int>(res);
+    errno = 0;
+
+    return true;
+}
+
 /**
  * @brief Transcode the buffer until the buffer has enough or until an error occurs.
  * The buffer needs at least 'end' bytes before transcoding stops. Returns true
@@ -337,6 +805,13 @@ bool transcoder_predict_filesize(LPVIRTUALFILE virtualfile, Cache_Entry* cache_e
 
 Cache_Entry* transcoder_new(LPVIRTUALFILE virtualfile, bool begin_transcode)
 {
+    if (begin_transcode && thread_drain)
+    {
+        Logging::warning(virtualfile->m_origfile, "Shutting down, not starting new transcoder.");
+        errno = EBUSY;
+        return nullptr;
+    }
+
     // Allocate transcoder structure
     Cache_Entry* cache_entry = cache->open(virtualfile);
     if (cache_entry == nullptr)
@@ -386,6 +861,39 @@ Cache_Entry* transcoder_new(LPVIRTUALFILE virtualfile, bool begin_transcode)
                     cache_entry->clear();
                 }
 
+                if (shared_attach(cache_entry))
+                {
+                    // Another process transcodes this file, reads will be served from its cache file.
+                    cache_entry->unlock();
+                    return cache_entry;
+                }
+
+                // Do not overload the CPU so that running transcoders miss real time
+                if (!admission_ok())
+                {
+                    // Do not block other opens and reads of this file while waiting
+                    cache_entry->unlock();
+                    admission_wait(cache_entry);
+                    cache_entry->lock();
+
+                    if (cache_entry->m_is_decoding || cache_entry->m_cache_info.m_finished == RESULTCODE_FINISHED)
+                    {
+                        // Started by another open in the meantime
+                        cache_entry->unlock();
+                        return cache_entry;
+                    }
+
+                    if (thread_drain)
+                    {
+                        // Shutdown began while waiting. Keep what is cached already.
+                        Logging::warning(cache_entry->filename(), "Shutting down, not starting new transcoder.");
+                        cache_entry->unlock();
+                        cache->close(&cache_entry, CACHE_CLOSE_NOOPT);
+                        errno = EBUSY;
+                        return nullptr;
+                    }
+                }
+
                 // Must decode the file, otherwise simply use cache
                 cache_entry->m_is_decoding  = true;
 
@@ -398,7 +906,22 @@ Cache_Entry* transcoder_new(LPVIRTUALFILE virtualfile, bool begin_transcode)
                 {
                     std::unique_lock<std::mutex> lock(thread_data->m_mutex);
 
-                    tp->schedule_thread(&transcoder_thread, thread_data);
+                    // Count the job while still queued so that transcoder_drain() waits for it
+                    ++running_transcoders;
+
+                    if (!tp->schedule_thread(&transcoder_thread, thread_data))
+                    {
+                        // Thread pool is shutting down. Keep what is cached already.
+                        --running_transcoders;
+                        lock.unlock();
+                        delete thread_data;
+                        Logging::warning(cache_entry->filename(), "Shutting down, not starting new transcoder.");
+                        cache_entry->m_is_decoding = false;
+                        cache_entry->unlock();
+                        cache->close(&cache_entry, CACHE_CLOSE_NOOPT);
+                        errno = EBUSY;
+                        return nullptr;
+                    }
 
 					// Let decoder get into gear before returning from open
                     while (!thread_data->m_lock_guard)
@@ -466,6 +989,11 @@ bool transcoder_read(Cache_Entry* cache_entry, char* buff, size_t offset, size_t
     // Update read counter
     cache_entry->update_read_count();
 
+    if ((cache_entry->m_shared_session != -1 && !cache_entry->m_shared_owner) || !cache_entry->m_shared_cachefile.empty())
+    {
+        return transcoder_read_shared(cache_entry, buff, offset, len, bytes_read);
+    }
+
     try
     {
 #define MIN_SEGMENT 3   /**< @brief Seek segment if more distant than this range @todo Should count in seconds, not segments... */
@@ -723,6 +1251,31 @@ void transcoder_exit(void)
     thread_exit = true;
 }
 
+void transcoder_drain(void)
+{
+    // Also keeps transcoders that are about to start from running
+    thread_drain = true;
+
+    if (!running_transcoders)
+    {
+        return;
+    }
+
+    Logging::info(nullptr, "Draining %1 running transcoder(s), waiting up to %2.", static_cast<int>(running_transcoders), format_time(params.m_drain_timeout).c_str());
+
+    time_t start = time(nullptr);
+
+    while (running_transcoders && time(nullptr) - start < params.m_drain_timeout)
+    {
+        usleep(100000);
+    }
+
+    if (running_transcoders)
+    {
+        Logging::warning(nullptr, "%1 transcoder(s) did not stop in time, aborting them.", static_cast<int>(running_transcoders));
+    }
+}
+
 bool transcoder_cache_maintenance(void)
 {
     if (cache != nullptr)
@@ -735,6 +1288,26 @@ bool transcoder_cache_maintenance(void)
     }
 }
 
+bool transcoder_read_disc(const std::string & path, uint64_t stamp, std::vector<VIRTUALFILE> *virtualfiles)
+{
+    if (cache == nullptr)
+    {
+        return false;
+    }
+
+    return cache->read_disc(path, params.m_format[0].desttype(), stamp, virtualfiles);
+}
+
+bool transcoder_write_disc(const std::string & path, uint64_t stamp, const std::vector<LPCVIRTUALFILE> & virtualfiles)
+{
+    if (cache == nullptr)
+    {
+        return false;
+    }
+
+    return cache->write_disc(path, params.m_format[0].desttype(), stamp, virtualfiles);
+}
+
 bool transcoder_cache_clear(void)
 {
     if (cache != nullptr)
@@ -759,6 +1332,8 @@ static void transcoder_thread(void *arg)
     int averror = 0;
     int syserror = 0;
     bool timeout = false;
+    bool released = false;
+    bool drained = false;
     bool success = true;
 
     std::unique_lock<std::recursive_mutex> lock(cache_entry->m_active_mutex);
@@ -809,10 +1384,19 @@ static void transcoder_thread(void *arg)
             throw (static_cast<int>(errno));
         }
 
-        averror = transcoder->open_output_file(cache_entry->m_buffer);
-        if (averror < 0)
+        if (transcoder->is_hls() && !cache_entry->m_buffer->next_unfinished_segment(1))
         {
-            throw (static_cast<int>(errno));
+            // An earlier run has completed all segments, but did not get to mark the file finished.
+            Logging::info(cache_entry->destname(), "All HLS segments are already complete, nothing to transcode.");
+            cache_entry->m_cache_info.m_finished = RESULTCODE_FINISHED;
+        }
+        else
+        {
+            averror = transcoder->open_output_file(cache_entry->m_buffer);
+            if (averror < 0)
+            {
+                throw (static_cast<int>(errno));
+            }
         }
 
         memcpy(&cache_entry->m_id3v1, transcoder->id3v1tag(), sizeof(ID3v1));
@@ -832,6 +1416,9 @@ static void transcoder_thread(void *arg)
             Logging::debug(cache_entry->destname(), "Pre-buffering up to %1 bytes.", params.m_prebuffer_size);
         }
 
+        uint32_t checkpoint_segment = cache_entry->m_buffer->current_segment_no();
+        uint32_t drain_segment = 0;
+
         while ((cache_entry->m_cache_info.m_finished != RESULTCODE_FINISHED) && !(timeout = cache_entry->decode_timeout()) && !thread_exit)
         {
             int status = 0;
@@ -872,6 +1459,18 @@ static void transcoder_thread(void *arg)
             }
 
             averror = transcoder->process_single_fr(status);
+
+            admission_update(cache_entry, transcoder, false);
+
+            shared_update(cache_entry);
+
+            if (transcoder->is_hls() && cache_entry->m_buffer->current_segment_no() != checkpoint_segment)
+            {
+                // A segment has been completed, save progress in case we get killed
+                checkpoint_segment = cache_entry->m_buffer->current_segment_no();
+                cache_entry->checkpoint();
+            }
+
             if (status < 0)
             {
                 syserror = EIO;
@@ -886,6 +1485,22 @@ static void transcoder_thread(void *arg)
                 break;
             }
 
+            // A transcode that has just reached its end is complete, no need to stop it
+            if (thread_drain && status != 1)
+            {
+                // Shutting down: complete the segment someone is waiting for, stop all others right away.
+                if (drain_segment == 0)
+                {
+                    drain_segment = checkpoint_segment;
+                }
+
+                if (!transcoder->is_hls() || cache_entry->ref_count() <= 1 || checkpoint_segment != drain_segment)
+                {
+                    drained = true;
+                    break;
+                }
+            }
+
             if (!unlocked && cache_entry->m_buffer->buffer_watermark() > params.m_prebuffer_size)
             {
                 unlocked = true;
@@ -894,7 +1509,18 @@ static void transcoder_thread(void *arg)
                 thread_data->m_cond.notify_all();       // signal that we are running
             }
 
-            if (cache_entry->ref_count() <= 1 && cache_entry->suspend_timeout())
+            // The largest transcoders give way when memory runs short, those nobody is waiting for first
+            bool suspend = (cache_entry->ref_count() <= 1 && cache_entry->suspend_timeout());
+            bool out_of_memory = (!suspend && memory_check(cache_entry, transcoder));
+
+            if (out_of_memory && cache_entry->ref_count() > 1)
+            {
+                // Someone is waiting: slow down instead of stopping
+                usleep(100000);
+                out_of_memory = false;
+            }
+
+            if (suspend || out_of_memory)
             {
                 if (!unlocked && params.m_prebuffer_size)
                 {
@@ -903,13 +1529,44 @@ static void transcoder_thread(void *arg)
                     thread_data->m_cond.notify_all();  // signal that we are running
                 }
 
-                Logging::info(cache_entry->destname(), "Suspend timeout. Transcoding suspended after %1 seconds inactivity.", params.m_max_inactive_suspend);
+                if (transcoder->is_hls())
+                {
+                    // Finished segments are kept in the cache, so there is no need to hold the transcoder
+                    // and a pool thread. The next access starts a new one which resumes at the first
+                    // unfinished segment, only the current segment must be done again.
+                    released = true;
+                    if (suspend)
+                    {
+                        Logging::info(cache_entry->destname(), "Suspend timeout. Transcoding suspended after %1 seconds inactivity, releasing transcoder.", params.m_max_inactive_suspend);
+                    }
+                    else
+                    {
+                        Logging::info(cache_entry->destname(), "Memory limit reached. Transcoding suspended, releasing transcoder.");
+                    }
+                    break;
+                }
+
+                if (suspend)
+                {
+                    Logging::info(cache_entry->destname(), "Suspend timeout. Transcoding suspended after %1 seconds inactivity.", params.m_max_inactive_suspend);
+                }
+                else
+                {
+                    Logging::info(cache_entry->destname(), "Memory limit reached. Transcoding suspended.");
+                }
+
+                // Let another transcoder run while waiting
+                tp->job_idle();
 
-                while (cache_entry->suspend_timeout() && !(timeout = cache_entry->decode_timeout()) && !thread_exit)
+                while ((cache_entry->suspend_timeout() || (cache_entry->ref_count() <= 1 && memory_check(cache_entry, transcoder))) && !(timeout = cache_entry->decode_timeout()) && !thread_exit && !thread_drain)
                 {
                     sleep(1);
+                    // Readers in other processes wake us up, too
+                    shared_update(cache_entry);
                 }
 
+                tp->job_busy();
+
                 if (timeout)
                 {
                     break;
@@ -940,15 +1597,36 @@ static void transcoder_thread(void *arg)
         thread_data->m_cond.notify_all();           // unlock main thread
     }
 
-    transcoder->close();
+    bool have_seeked = false;
 
-    delete transcoder;
+    if (transcoder != nullptr)
+    {
+        admission_update(cache_entry, transcoder, true);
+        memory_remove(cache_entry);
+
+        // Segments skipped by seeking or left by suspension or shutdown must be transcoded later, unless they have been completed in the meantime.
+        have_seeked = (transcoder->have_seeked() || released || ((thread_exit || drained) && transcoder->is_hls())) && !(transcoder->is_hls() && !cache_entry->m_buffer->next_unfinished_segment(1));
+
+        transcoder->close();
 
-    if (timeout || thread_exit || transcoder->have_seeked())
+        delete transcoder;
+    }
+
+    if (timeout || thread_exit || drained || have_seeked)
     {
         cache_entry->m_is_decoding              = false;
 
-        if (!transcoder->have_seeked())
+        if (drained && !have_seeked)
+        {
+            // Partial result cannot be resumed, discard it without marking it failed.
+            cache_entry->m_cache_info.m_finished    = RESULTCODE_NONE;
+            cache_entry->m_cache_info.m_error       = false;
+            cache_entry->m_cache_info.m_errno       = 0;
+            cache_entry->m_cache_info.m_averror     = 0;
+
+            Logging::info(cache_entry->destname(), "Shutting down! Transcoding stopped, will start over at next access.");
+        }
+        else if (!have_seeked)
         {
             cache_entry->m_cache_info.m_finished    = RESULTCODE_ERROR;
             cache_entry->m_cache_info.m_error       = true;
@@ -966,6 +1644,11 @@ static void transcoder_thread(void *arg)
         }
         else
         {
+            if (thread_exit || drained)
+            {
+                Logging::info(cache_entry->destname(), "Shutting down! Transcoding stopped, completed segments are kept.");
+            }
+
             // Must restart from scratch, but this is not an error.
             cache_entry->m_cache_info.m_finished    = RESULTCODE_INCOMPLETE;
             cache_entry->m_cache_info.m_error       = false;
@@ -998,10 +1681,19 @@ static void transcoder_thread(void *arg)
         }
     }
 
+    if (cache_entry->m_shared_owner)
+    {
+        shared_session_release(cache_entry->m_shared_session, cache_entry->m_buffer->buffer_watermark(), cache_entry->m_cache_info.m_finished == RESULTCODE_FINISHED && !cache_entry->m_cache_info.m_error);
+        cache_entry->m_shared_session   = -1;
+        cache_entry->m_shared_owner     = false;
+    }
+
     cache->close(&cache_entry, timeout ? CACHE_CLOSE_DELETE : CACHE_CLOSE_NOOPT);
 
     delete thread_data;
 
+    --running_transcoders;
+
     errno = syserror;
 }
 
@@ -47,6 +47,20 @@
  *  @return Returns true if file was found in cache, false if not (stbuf will be unchanged)
  */
 bool            transcoder_cached_filesize(LPVIRTUALFILE virtualfile, struct stat *stbuf);
+/** @brief Get the titles of a DVD, Blu-ray or Video CD from an earlier scan
+ *  @param[in] path - path to disc
+ *  @param[in] stamp - stamp of the disc structure, outdated titles are ignored
+ *  @param[out] virtualfiles - virtual files of the titles
+ *  @return Returns true if the titles were found in the cache, false if not
+ */
+bool            transcoder_read_disc(const std::string & path, uint64_t stamp, std::vector<VIRTUALFILE> *virtualfiles);
+/** @brief Store the titles of a DVD, Blu-ray or Video CD for the next time
+ *  @param[in] path - path to disc
+ *  @param[in] stamp - stamp of the disc structure
+ *  @param[in] virtualfiles - virtual files of the titles
+ *  @return Returns true on success, false on error
+ */
+bool            transcoder_write_disc(const std::string & path, uint64_t stamp, const std::vector<LPCVIRTUALFILE> & virtualfiles);
 // Set the file size
 /** @brief
  *  @param[in] virtualfile - virtual file object to open.
@@ -144,5 +158,12 @@ size_t          transcoder_buffer_tell(Cache_Entry* cache_entry, uint32_t segmen
  * Send signal to exit transcoding (ending all transcoder threads).
  */
 void            transcoder_exit(void);
+/** @brief Drain transcoding before shutdown
+ *
+ * New transcoders will not be started any more. Transcoders that serve a reader complete
+ * their current HLS segment, all others stop at once, keeping what can be resumed.
+ * Waits until all transcoders have stopped, but not longer than params.m_drain_timeout.
+ */
+void            transcoder_drain(void);
 
 #endif
@@ -195,9 +195,19 @@ int check_vcd(const std::string & _path, void *buf, fuse_fill_dir_t filler)
     {
         if (!check_path(path))
         {
-            Logging::trace(path, "VCD detected.");
-            res = parse_vcd(path, &stbuf, buf, filler);
-            Logging::trace(nullptr, "Found %1 titles.", res);
+            uint64_t stamp = disc_stamp(path);
+
+            res = load_disc(VIRTUALTYPE_VCD, path, stamp, &stbuf, buf, filler);
+            if (!res)
+            {
+                Logging::trace(path, "VCD detected.");
+                res = parse_vcd(path, &stbuf, buf, filler);
+                Logging::trace(nullptr, "Found %1 titles.", res);
+                if (res > 0)
+                {
+                    save_disc(VIRTUALTYPE_VCD, path, stamp);
+                }
+            }
         }
         else
         {
@@ -208,9 +218,19 @@ int check_vcd(const std::string & _path, void *buf, fuse_fill_dir_t filler)
     {
         if (!check_path(path))
         {
-            Logging::trace(path, "VCD detected.");
-            res = parse_vcd(path, &stbuf, buf, filler);
-            Logging::trace(nullptr, "Found %1 titles.", res);
+            uint64_t stamp = disc_stamp(path);
+
+            res = load_disc(VIRTUALTYPE_VCD, path, stamp, &stbuf, buf, filler);
+            if (!res)
+            {
+                Logging::trace(path, "VCD detected.");
+                res = parse_vcd(path, &stbuf, buf, filler);
+                Logging::trace(nullptr, "Found %1 titles.", res);
+                if (res > 0)
+                {
+                    save_disc(VIRTUALTYPE_VCD, path, stamp);
+                }
+            }
         }
         else
         {
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * On Debian systems, the complete text of the GNU General Public License
+ * Version 3 can be found in `/usr/share/common-licenses/GPL-3'.
+ */
+
+/**
+ * @file
+ * @brief Source file change detection implementation
+ *
+ * @ingroup ffmpegfs
+ *
+ * @author Norbert Schlia (nschlia@oblivion-software.de)
+ * @copyright Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ */
+
+#include "watcher.h"
+#include "ffmpeg_utils.h"
+#include "logging.h"
+
+#include <unistd.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+#define WATCHER_EVENTS      (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)   /**< @brief Events that change a source */
+#define WATCHER_MAX_FILES   10000       /**< @brief Max. number of changed files remembered, older changes are forgotten */
+#define WATCHER_POLL_MS     500         /**< @brief Interval to check for a stop request */
+
+/**
+ * @brief Watched directory
+ */
+typedef struct WATCH
+{
+    std::string     m_dir;                                      /**< @brief Directory name, with trailing separator */
+    uint64_t        m_added;                                    /**< @brief Sequence number when the watch was added */
+} WATCH;
+
+static int                              inotify_fd = -1;        /**< @brief inotify instance */
+static std::thread                      watcher_thread;         /**< @brief Thread reading events */
+static std::atomic_bool                 watcher_stop(false);    /**< @brief Set to stop the thread */
+static std::mutex                       watcher_mutex;          /**< @brief Protects the tables below */
+static std::map<int, WATCH>             watches;                /**< @brief Watched directories by watch descriptor */
+static std::map<std::string, int>       watched_dirs;           /**< @brief Watch descriptors by directory name */
+static std::map<std::string, uint64_t>  changed_files;          /**< @brief Sequence number of last change by file name */
+static uint64_t                         sequence = 0;           /**< @brief Last sequence number used */
+static uint64_t                         forgotten = 0;          /**< @brief Changes up to this sequence number have been forgotten */
+
+static void watcher_run();
+static void remove_watches(const std::string & dir);
+static void handle_event(const struct inotify_event *event);
+
+/**
+ * @brief Stop watching a directory and all directories below it. watcher_mutex must be locked.
+ *
+ * inotify follows the inode, not the name. After a directory has been moved or deleted, the watches
+ * of directories below it still report events, but for a different path. A directory created under
+ * the old name later would be trusted without having been watched.
+ *
+ * @param[in] dir - Directory name, with trailing separator.
+ */
+static void remove_watches(const std::string & dir)
+{
+    std::map<std::string, int>::iterator it = watched_dirs.lower_bound(dir);
+
+    while (it != watched_dirs.end() && !it->first.compare(0, dir.size(), dir))
+    {
+        Logging::trace(it->first, "Directory is no longer watched.");
+
+        inotify_rm_watch(inotify_fd, it->second);
+        watches.erase(it->second);
+        it = watched_dirs.erase(it);
+    }
+}
+
+/**
+ * @brief Record an event. watcher_mutex must be locked.
+ * @param[in] event - inotify event.
+ */
+static void handle_event(const struct inotify_event *event)
+{
+    if (event->mask & IN_Q_OVERFLOW)
+    {
+        // Events have been lost, everything may have changed
+        Logging::warning(nullptr, "Source watcher event queue overflowed, checking all files again.");
+        forgotten = ++sequence;
+        changed_files.clear();
+        return;
+    }
+
+    std::map<int, WATCH>::iterator it = watches.find(event->wd);
+    if (it == watches.end())
+    {
+        return;
+    }
+
+    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+    {
+        // Directory has gone, files in it and in directories below it are no longer watched. Copy the name, the entry is removed.
+        std::string dir(it->second.m_dir);
+        remove_watches(dir);
+        return;
+    }
+
+    if (event->len)
+    {
+        if ((event->mask & IN_ISDIR) && (event->mask & (IN_DELETE | IN_MOVED_FROM)))
+        {
+            // Subdirectory moved away or deleted, also catches directories further down the tree
+            remove_watches(it->second.m_dir + event->name + "/");
+        }
+
+        if (changed_files.size() >= WATCHER_MAX_FILES)
+        {
+            forgotten = sequence;
+            changed_files.clear();
+        }
+
+        changed_files[it->second.m_dir + event->name] = ++sequence;
+    }
+}
+
+/**
+ * @brief Watcher thread: read and record events until stopped.
+ */
+static void watcher_run()
+{
+    // Buffer aligned for struct inotify_event, large enough for many events
+    alignas(struct inotify_event) char buffer[64 * 1024];
+
+    while (!watcher_stop)
+    {
+        struct pollfd pfd;
+
+        pfd.fd      = inotify_fd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+
+        int ret = poll(&pfd, 1, WATCHER_POLL_MS);
+        if (ret <= 0)
+        {
+            if (ret == -1 && errno != EINTR)
+            {
+                Logging::error(nullptr, "Source watcher poll error (%1) %2", errno, strerror(errno));
+                break;
+            }
+            continue;
+        }
+
+        ssize_t len = read(inotify_fd, buffer, sizeof(buffer));
+        if (len <= 0)
+        {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(watcher_mutex);
+
+        for (char *p = buffer; p < buffer + len;)
+        {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+
+            handle_event(event);
+
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+bool start_watcher()
+{
+    Logging::debug(nullptr, "Starting source watcher.");
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1)
+    {
+        Logging::error(nullptr, "start_watcher(): inotify_init1 error (%1) %2", errno, strerror(errno));
+        return false;
+    }
+
+    watcher_stop = false;
+    watcher_thread = std::thread(watcher_run);
+
+    return true;
+}
+
+bool stop_watcher()
+{
+    if (inotify_fd == -1)
+    {
+        return true;
+    }
+
+    Logging::info(nullptr, "Stopping source watcher.");
+
+    watcher_stop = true;
+    if (watcher_thread.joinable())
+    {
+        watcher_thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(watcher_mutex);
+
+    watches.clear();
+    watched_dirs.clear();
+    changed_files.clear();
+
+    // Removes all watches
+    bool success = (close(inotify_fd) == 0);
+    if (!success)
+    {
+        Logging::error(nullptr, "stop_watcher(): close error (%1) %2", errno, strerror(errno));
+    }
+    inotify_fd = -1;
+
+    return success;
+}
+
+void watcher_add(const std::string & _dir)
+{
+    if (inotify_fd == -1)
+    {
+        return;
+    }
+
+    std::string dir(_dir);
+
+    append_sep(&dir);
+
+    std::lock_guard<std::mutex> lock(watcher_mutex);
+
+    if (watched_dirs.find(dir) != watched_dirs.end())
+    {
+        return;
+    }
+
+    int wd = inotify_add_watch(inotify_fd, dir.c_str(), WATCHER_EVENTS | IN_ONLYDIR);
+    if (wd == -1)
+    {
+        // E.g. max_user_watches reached, files in this directory will be checked with stat()
+        Logging::debug(dir, "Unable to watch directory: (%1) %2", errno, strerror(errno));
+        return;
+    }
+
+    // The same directory under another name (e.g. a symlink) gets the same descriptor
+    std::map<int, WATCH>::iterator it = watches.find(wd);
+    if (it != watches.end())
+    {
+        return;
+    }
+
+    Logging::trace(dir, "Watching directory.");
+
+    watches[wd]         = { dir, ++sequence };
+    watched_dirs[dir]   = wd;
+}
+
+uint64_t watcher_sequence()
+{
+    std::lock_guard<std::mutex> lock(watcher_mutex);
+
+    return (inotify_fd != -1) ? sequence : 0;
+}
+
+bool watcher_unchanged(const std::string & filename, uint64_t since)
+{
+    if (inotify_fd == -1 || !since)
+    {
+        return false;
+    }
+
+    std::string dir(filename);
+
+    remove_filename(&dir);
+
+    std::lock_guard<std::mutex> lock(watcher_mutex);
+
+    if (since < forgotten)
+    {
+        return false;
+    }
+
+    // Directory must have been watched already when the file was checked
+    std::map<std::string, int>::const_iterator it_dir = watched_dirs.find(dir);
+    if (it_dir == watched_dirs.end() || watches[it_dir->second].m_added > since)
+    {
+        return false;
+    }
+
+    std::map<std::string, uint64_t>::const_iterator it_file = changed_files.find(filename);
+
+    return (it_file == changed_files.end() || it_file->second <= since);
+}
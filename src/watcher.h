@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * On Debian systems, the complete text of the GNU General Public License
+ * Version 3 can be found in `/usr/share/common-licenses/GPL-3'.
+ */
+
+/**
+ * @file
+ * @brief Source file change detection
+ *
+ * Watches the input directories with inotify. Directories are added when
+ * they are listed or a file in them is checked. Each change is numbered
+ * with an increasing sequence number; a caller that has checked a file
+ * remembers the sequence number of the check, and later only needs to
+ * ask the watcher if the file was changed since, instead of calling stat().
+ *
+ * Whenever the watcher cannot tell for sure (directory not watched, event
+ * queue overflow, watcher not running), files count as changed so the
+ * caller falls back to checking them.
+ *
+ * @ingroup ffmpegfs
+ *
+ * @author Norbert Schlia (nschlia@oblivion-software.de)
+ * @copyright Copyright (C) 2017-2020 Norbert Schlia (nschlia@oblivion-software.de)
+ */
+
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+/**
+ * @brief Start watching source files.
+ * @return On success, returns true. On error, returns false. Check errno for details.
+ */
+bool        start_watcher();
+/**
+ * @brief Stop watching source files.
+ * @return On success, returns true. On error, returns false. Check errno for details.
+ */
+bool        stop_watcher();
+/**
+ * @brief Watch a directory, if not already watched.
+ * @param[in] dir - Directory to watch.
+ */
+void        watcher_add(const std::string & dir);
+/**
+ * @brief Get the current change sequence number.
+ *
+ * Take it before checking a file, changes made while checking will be seen next time.
+ *
+ * @return Returns the sequence number, or 0 if the watcher is not running.
+ */
+uint64_t    watcher_sequence();
+/**
+ * @brief Check if a file is unchanged since a given sequence number.
+ * @param[in] filename - File to check.
+ * @param[in] since - Sequence number when the file was checked last, as returned by watcher_sequence().
+ * @return Returns true if the file is surely unchanged, false if it was changed or the watcher cannot tell.
+ */
+bool        watcher_unchanged(const std::string & filename, uint64_t since);
+
+#endif // WATCHER_H
@@ -11,6 +11,11 @@ cleanup () {
     # Remove temporary directories
     rmdir "${DIRNAME}"
     rm -Rf "${CACHEPATH}"
+    # Test specific clean up
+    if [ -n "${EXTRA_CLEANUP}" ]
+    then
+        eval "${EXTRA_CLEANUP}"
+    fi
     # Arrividerci
     exit ${EXIT}
 }
@@ -71,12 +76,13 @@ then
 else
     FILEEXT=${DESTTYPE}
 fi
-SRCDIR="$( cd "${BASH_SOURCE%/*}/srcdir" && pwd )"
+# May be preset by the test, as well as EXTRA_OPTS for additional mount options
+SRCDIR="${SRCDIR:-$( cd "${BASH_SOURCE%/*}/srcdir" && pwd )}"
 DIRNAME="$(mktemp -d)"
 CACHEPATH="$(mktemp -d)"
 
 #--disable_cache
-( ffmpegfs -f "${SRCDIR}" "${DIRNAME}" --logfile=$0_${DESTTYPE}.builtin.log --log_maxlevel=TRACE --cachepath="${CACHEPATH}" --desttype=${DESTTYPE} > /dev/null || kill -USR1 $$ ) &
+( ffmpegfs -f "${SRCDIR}" "${DIRNAME}" --logfile=$0_${DESTTYPE}.builtin.log --log_maxlevel=TRACE --cachepath="${CACHEPATH}" --desttype=${DESTTYPE} ${EXTRA_OPTS} > /dev/null || kill -USR1 $$ ) &
 while ! mount | grep -q "${DIRNAME}" ; do
     sleep 0.1
 done
@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+#
+# Serve the current directory over HTTP with support for range requests,
+# which python3 -m http.server lacks.
+#
+# Usage: httpserver.py PORT
+
+import http.server
+import os
+import re
+import sys
+
+
+class RangeRequestHandler(http.server.SimpleHTTPRequestHandler):
+    # Keep connections alive between range requests
+    protocol_version = "HTTP/1.1"
+
+    def send_head(self):
+        path = self.translate_path(self.path)
+        if not os.path.isfile(path):
+            return super().send_head()
+
+        size = os.path.getsize(path)
+        start, end = 0, size - 1
+
+        match = re.match(r"bytes=(\d*)-(\d*)$", self.headers.get("Range", ""))
+        if match and (match.group(1) or match.group(2)):
+            if match.group(1):
+                start = int(match.group(1))
+                if match.group(2):
+                    end = min(int(match.group(2)), size - 1)
+            else:
+                start = max(size - int(match.group(2)), 0)
+            if start >= size or start > end:
+                self.send_response(416)
+                self.send_header("Content-Range", "bytes */%d" % size)
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return None
+            self.send_response(206)
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end, size))
+        else:
+            self.send_response(200)
+
+        f = open(path, "rb")
+        f.seek(start)
+        self.range_left = end - start + 1
+        self.send_header("Content-Type", self.guess_type(path))
+        self.send_header("Content-Length", str(self.range_left))
+        self.send_header("Accept-Ranges", "bytes")
+        self.end_headers()
+        return f
+
+    def copyfile(self, source, outputfile):
+        while self.range_left > 0:
+            data = source.read(min(self.range_left, 64 * 1024))
+            if not data:
+                break
+            outputfile.write(data)
+            self.range_left -= len(data)
+
+    def log_message(self, format, *args):
+        pass
+
+
+if __name__ == "__main__":
+    http.server.ThreadingHTTPServer(("127.0.0.1", int(sys.argv[1])), RangeRequestHandler).serve_forever()